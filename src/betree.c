@@ -0,0 +1,713 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "betree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+#define OVERFULL(x) ((x)->n > (((x)->leaf) ? BET_LEAF : BET_FANOUT))
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+enum betmsg_type { BET_PUT, BET_DEL };
+
+/* buffered update */
+struct betmsg
+{
+    long key;
+    void *data;
+    enum betmsg_type type;
+};
+
+/* a leaf holds n items with keys[i] and data ptr[i]. An inner node has n
+ * children in ptr and n - 1 pivots in keys; child i holds the keys in
+ * [keys[i - 1], keys[i]). Its buffer holds updates for its subtree that
+ * are newer than the ones further down, sorted by key, one per key */
+typedef struct betnode betnode;
+struct betnode
+{
+    int leaf;
+    size_t n, cap;
+    long *keys;
+    void **ptr;
+    struct betmsg *msgs;
+    size_t nmsgs, msgcap;
+};
+
+/* tree object, a pointer to it is the first argument to all bet_ functions */
+struct betree
+{
+    betnode *root;
+    void (*callback)(void*);
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* create an empty node */
+static betnode *betnode_init(int leaf);
+
+/* free a node and all nodes below it, calling the callback on all data */
+static void betnode_free(betree *t, betnode *n);
+
+/* make room for cap items/children */
+static int bet_reserve(betnode *n, size_t cap);
+
+/* number of keys < key, or <= key if upper is set */
+static size_t bet_search(const long *keys, size_t n, long key, int upper);
+
+/* number of buffered updates with key < key */
+static size_t bet_msg_search(const struct betmsg *msgs, size_t n, long key);
+
+/* child of an inner node key belongs in */
+static size_t bet_child(betnode *n, long key);
+
+/* add an update to the buffer of an inner node */
+static int bet_buffer(betree *t, betnode *n, struct betmsg *m);
+
+/* apply m sorted updates to a leaf / merge them into the buffer of an
+ * inner node */
+static int bet_apply(betree *t, betnode *leaf, struct betmsg *msgs, size_t m);
+static int bet_merge(betree *t, betnode *n, struct betmsg *msgs, size_t m);
+
+/* move the upper half of n to a new node, store it and the lowest key
+ * that went there */
+static int bet_split(betnode *n, betnode **right, long *pivot);
+
+/* split child i of p into nodes that aren't overfull, or remove it if
+ * it's an empty leaf */
+static int bet_fix(betree *t, betnode *p, size_t i);
+
+/* add a root while the root is overfull, drop it while it has just one
+ * child */
+static int bet_fix_root(betree *t);
+
+/* move the buffered updates s..e of n to child i */
+static int bet_push(betree *t, betnode *n, size_t i, size_t s, size_t e);
+
+/* move buffered updates down until the buffer of n isn't full */
+static int bet_flush(betree *t, betnode *n);
+
+/* move all buffered updates in [lo, hi] below n down to the leaves */
+static int bet_push_range(betree *t, betnode *n, long lo, long hi);
+
+/* add an update to the tree */
+static int bet_update(betree *t, long key, void *data, enum betmsg_type type);
+
+/* return non-zero if key is in t, store its data in *data */
+static int bet_find(betree *t, long key, void **data);
+
+/* bet_range() on the leaves below n */
+static size_t bet_range_node(betnode *n, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static betnode *betnode_init(int leaf)
+{
+    betnode *n = malloc(sizeof *n);
+
+    if (!n)
+        return NULL;
+
+    n->leaf = leaf;
+    n->n = n->cap = 0;
+    n->keys = NULL;
+    n->ptr = NULL;
+    n->msgs = NULL;
+    n->nmsgs = n->msgcap = 0;
+    return n;
+}
+
+static void betnode_free(betree *t, betnode *n)
+{
+    size_t i;
+
+    for (i = 0; i < n->n; i++)
+    {
+        if (!n->leaf)
+            betnode_free(t, n->ptr[i]);
+        else if (t->callback)
+            t->callback(n->ptr[i]);
+    }
+
+    for (i = 0; i < n->nmsgs; i++)
+    {
+        if (t->callback && n->msgs[i].type == BET_PUT)
+            t->callback(n->msgs[i].data);
+    }
+
+    free(n->keys);
+    free(n->ptr);
+    free(n->msgs);
+    free(n);
+}
+
+static int bet_reserve(betnode *n, size_t cap)
+{
+    long *keys;
+    void **ptr;
+
+    if (cap <= n->cap)
+        return 0;
+    if (cap < 2 * n->cap)
+        cap = 2 * n->cap;
+
+    if (!(keys = realloc(n->keys, cap * sizeof *keys)))
+        return -1;
+    n->keys = keys;
+
+    if (!(ptr = realloc(n->ptr, cap * sizeof *ptr)))
+        return -1;
+    n->ptr = ptr;
+
+    n->cap = cap;
+    return 0;
+}
+
+static size_t bet_search(const long *keys, size_t n, long key, int upper)
+{
+    size_t lo = 0, mid;
+
+    while (n)
+    {
+        mid = lo + n / 2;
+        if (keys[mid] < key || (upper && keys[mid] == key))
+        {
+            lo = mid + 1;
+            n -= n / 2 + 1;
+        }
+        else
+            n /= 2;
+    }
+    return lo;
+}
+
+static size_t bet_msg_search(const struct betmsg *msgs, size_t n, long key)
+{
+    size_t lo = 0, mid;
+
+    while (n)
+    {
+        mid = lo + n / 2;
+        if (msgs[mid].key < key)
+        {
+            lo = mid + 1;
+            n -= n / 2 + 1;
+        }
+        else
+            n /= 2;
+    }
+    return lo;
+}
+
+static size_t bet_child(betnode *n, long key)
+{
+    return bet_search(n->keys, n->n - 1, key, 1);
+}
+
+static int bet_buffer(betree *t, betnode *n, struct betmsg *m)
+{
+    struct betmsg *msgs;
+    size_t i = bet_msg_search(n->msgs, n->nmsgs, m->key), cap;
+
+    /* the newer update replaces the older one */
+    if (i < n->nmsgs && n->msgs[i].key == m->key)
+    {
+        if (t->callback && n->msgs[i].type == BET_PUT)
+            t->callback(n->msgs[i].data);
+        n->msgs[i] = *m;
+        return 0;
+    }
+
+    if (n->nmsgs == n->msgcap)
+    {
+        cap = (n->msgcap) ? 2 * n->msgcap : BET_BUFFER + 1;
+        if (!(msgs = realloc(n->msgs, cap * sizeof *msgs)))
+            return -1;
+        n->msgs = msgs;
+        n->msgcap = cap;
+    }
+
+    memmove(n->msgs + i + 1, n->msgs + i, (n->nmsgs - i) * sizeof *n->msgs);
+    n->msgs[i] = *m;
+    n->nmsgs++;
+    return 0;
+}
+
+static int bet_apply(betree *t, betnode *leaf, struct betmsg *msgs, size_t m)
+{
+    long *keys;
+    void **ptr;
+    size_t i = 0, j = 0, k = 0, cap = leaf->n + m;
+
+    if (cap < BET_LEAF)
+        cap = BET_LEAF;
+
+    keys = malloc(cap * sizeof *keys);
+    ptr = malloc(cap * sizeof *ptr);
+    if (!keys || !ptr)
+    {
+        free(keys);
+        free(ptr);
+        return -1;
+    }
+
+    while (i < leaf->n || j < m)
+    {
+        if (j == m || (i < leaf->n && leaf->keys[i] < msgs[j].key))
+        {
+            keys[k] = leaf->keys[i];
+            ptr[k++] = leaf->ptr[i++];
+            continue;
+        }
+
+        /* the update replaces or removes the item */
+        if (i < leaf->n && leaf->keys[i] == msgs[j].key)
+        {
+            if (t->callback)
+                t->callback(leaf->ptr[i]);
+            i++;
+        }
+
+        if (msgs[j].type == BET_PUT)
+        {
+            keys[k] = msgs[j].key;
+            ptr[k++] = msgs[j].data;
+        }
+        j++;
+    }
+
+    free(leaf->keys);
+    free(leaf->ptr);
+    leaf->keys = keys;
+    leaf->ptr = ptr;
+    leaf->n = k;
+    leaf->cap = cap;
+    return 0;
+}
+
+static int bet_merge(betree *t, betnode *n, struct betmsg *msgs, size_t m)
+{
+    struct betmsg *out;
+    size_t i = 0, j = 0, k = 0, cap = n->nmsgs + m;
+
+    if (cap <= BET_BUFFER)
+        cap = BET_BUFFER + 1;
+    if (!(out = malloc(cap * sizeof *out)))
+        return -1;
+
+    while (i < n->nmsgs || j < m)
+    {
+        if (j == m || (i < n->nmsgs && n->msgs[i].key < msgs[j].key))
+            out[k++] = n->msgs[i++];
+        else
+        {
+            /* msgs are newer */
+            if (i < n->nmsgs && n->msgs[i].key == msgs[j].key)
+            {
+                if (t->callback && n->msgs[i].type == BET_PUT)
+                    t->callback(n->msgs[i].data);
+                i++;
+            }
+            out[k++] = msgs[j++];
+        }
+    }
+
+    free(n->msgs);
+    n->msgs = out;
+    n->nmsgs = k;
+    n->msgcap = cap;
+    return 0;
+}
+
+static int bet_split(betnode *n, betnode **right, long *pivot)
+{
+    betnode *r;
+    size_t h = n->n / 2, s;
+
+    if (!(r = betnode_init(n->leaf)) || bet_reserve(r, n->n - h))
+        goto error;
+
+    r->n = n->n - h;
+    memcpy(r->ptr, n->ptr + h, r->n * sizeof *r->ptr);
+
+    if (n->leaf)
+    {
+        memcpy(r->keys, n->keys + h, r->n * sizeof *r->keys);
+        *pivot = r->keys[0];
+    }
+    else
+    {
+        /* the pivot between the halves moves up */
+        memcpy(r->keys, n->keys + h, (r->n - 1) * sizeof *r->keys);
+        *pivot = n->keys[h - 1];
+
+        s = bet_msg_search(n->msgs, n->nmsgs, *pivot);
+        if (s < n->nmsgs)
+        {
+            r->msgcap = BET_BUFFER + 1;
+            if (r->msgcap < n->nmsgs - s)
+                r->msgcap = n->nmsgs - s;
+            if (!(r->msgs = malloc(r->msgcap * sizeof *r->msgs)))
+                goto error;
+
+            r->nmsgs = n->nmsgs - s;
+            memcpy(r->msgs, n->msgs + s, r->nmsgs * sizeof *r->msgs);
+            n->nmsgs = s;
+        }
+    }
+
+    n->n = h;
+    *right = r;
+    return 0;
+
+error:
+    if (r)
+    {
+        free(r->keys);
+        free(r->ptr);
+        free(r);
+    }
+    return -1;
+}
+
+static int bet_fix(betree *t, betnode *p, size_t i)
+{
+    betnode *c = p->ptr[i], *right;
+    size_t end;
+    long pivot;
+
+    /* drop an empty leaf, unless it's the only child */
+    if (c->leaf && !c->n && p->n > 1)
+    {
+        betnode_free(t, c);
+        memmove(p->ptr + i, p->ptr + i + 1, (p->n - i - 1) * sizeof *p->ptr);
+        if (i)
+            i--;
+        memmove(p->keys + i, p->keys + i + 1, (p->n - i - 2) * sizeof *p->keys);
+        p->n--;
+        return 0;
+    }
+
+    /* split in halves; the right halves are checked when i gets there */
+    for (end = i; i <= end; )
+    {
+        c = p->ptr[i];
+        if (!OVERFULL(c))
+        {
+            i++;
+            continue;
+        }
+
+        if (bet_reserve(p, p->n + 1) || bet_split(c, &right, &pivot))
+            return -1;
+
+        memmove(p->ptr + i + 2, p->ptr + i + 1, (p->n - i - 1) * sizeof *p->ptr);
+        memmove(p->keys + i + 1, p->keys + i, (p->n - i - 1) * sizeof *p->keys);
+        p->ptr[i + 1] = right;
+        p->keys[i] = pivot;
+        p->n++;
+        end++;
+    }
+    return 0;
+}
+
+static int bet_fix_root(betree *t)
+{
+    betnode *r;
+
+    while (OVERFULL(t->root))
+    {
+        if (!(r = betnode_init(0)))
+            return -1;
+        if (bet_reserve(r, 2))
+        {
+            free(r->keys);
+            free(r->ptr);
+            free(r);
+            return -1;
+        }
+
+        r->ptr[0] = t->root;
+        r->n = 1;
+        t->root = r;
+        if (bet_fix(t, r, 0))
+            return -1;
+    }
+
+    while (!t->root->leaf && t->root->n == 1 && !t->root->nmsgs)
+    {
+        r = t->root;
+        t->root = r->ptr[0];
+        r->n = 0;
+        betnode_free(t, r);
+    }
+    return 0;
+}
+
+static int bet_push(betree *t, betnode *n, size_t i, size_t s, size_t e)
+{
+    betnode *c = n->ptr[i];
+
+    if ((c->leaf) ? bet_apply(t, c, n->msgs + s, e - s) :
+            bet_merge(t, c, n->msgs + s, e - s))
+        return -1;
+
+    memmove(n->msgs + s, n->msgs + e, (n->nmsgs - e) * sizeof *n->msgs);
+    n->nmsgs -= e - s;
+
+    if (!c->leaf && c->nmsgs > BET_BUFFER && bet_flush(t, c))
+        return -1;
+
+    return bet_fix(t, n, i);
+}
+
+static int bet_flush(betree *t, betnode *n)
+{
+    size_t i, s, e, best, bs = 0, be = 0;
+
+    while (n->nmsgs > BET_BUFFER)
+    {
+        /* the child with the most buffered updates gets them */
+        for (i = s = best = 0; i < n->n; i++, s = e)
+        {
+            e = (i + 1 < n->n) ?
+                bet_msg_search(n->msgs, n->nmsgs, n->keys[i]) : n->nmsgs;
+            if (!i || e - s > be - bs)
+            {
+                best = i;
+                bs = s;
+                be = e;
+            }
+        }
+
+        if (bet_push(t, n, best, bs, be))
+            return -1;
+    }
+    return 0;
+}
+
+static int bet_push_range(betree *t, betnode *n, long lo, long hi)
+{
+    size_t i, first, last, s, e;
+
+    if (n->leaf)
+        return 0;
+
+    while ((s = bet_msg_search(n->msgs, n->nmsgs, lo)) < n->nmsgs &&
+            n->msgs[s].key <= hi)
+    {
+        /* the updates in [lo, hi] for one child */
+        i = bet_child(n, n->msgs[s].key);
+        for (e = s; e < n->nmsgs && n->msgs[e].key <= hi &&
+                (i + 1 == n->n || n->msgs[e].key < n->keys[i]); e++)
+            ;
+
+        if (bet_push(t, n, i, s, e))
+            return -1;
+    }
+
+    /* last to first, so that splitting a child doesn't move the others */
+    first = bet_child(n, lo);
+    last = bet_child(n, hi);
+    for (i = last + 1; i-- > first; )
+    {
+        if (bet_push_range(t, n->ptr[i], lo, hi) || bet_fix(t, n, i))
+            return -1;
+    }
+    return 0;
+}
+
+static int bet_update(betree *t, long key, void *data, enum betmsg_type type)
+{
+    struct betmsg m;
+
+    if (!t || (!t->root && !(t->root = betnode_init(1))))
+        return -1;
+
+    m.key = key;
+    m.data = data;
+    m.type = type;
+
+    if (t->root->leaf)
+    {
+        if (bet_apply(t, t->root, &m, 1))
+            return -1;
+    }
+    else
+    {
+        if (bet_buffer(t, t->root, &m))
+            return -1;
+
+        /* the update is in, failing to move it down is no error */
+        if (t->root->nmsgs > BET_BUFFER)
+            bet_flush(t, t->root);
+    }
+
+    bet_fix_root(t);
+    return 0;
+}
+
+static int bet_find(betree *t, long key, void **data)
+{
+    betnode *n;
+    size_t i;
+
+    if (!t || !t->root)
+        return 0;
+
+    /* the first update on the way down is the newest */
+    for (n = t->root; !n->leaf; n = n->ptr[bet_child(n, key)])
+    {
+        i = bet_msg_search(n->msgs, n->nmsgs, key);
+        if (i < n->nmsgs && n->msgs[i].key == key)
+        {
+            *data = n->msgs[i].data;
+            return (n->msgs[i].type == BET_PUT);
+        }
+    }
+
+    i = bet_search(n->keys, n->n, key, 0);
+    if (i == n->n || n->keys[i] != key)
+        return 0;
+
+    *data = n->ptr[i];
+    return 1;
+}
+
+static size_t bet_range_node(betnode *n, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    size_t i, last, count = 0;
+
+    if (!n->leaf)
+    {
+        last = bet_child(n, hi);
+        for (i = bet_child(n, lo); i <= last; i++)
+            count += bet_range_node(n->ptr[i], lo, hi, callback, arg);
+        return count;
+    }
+
+    for (i = bet_search(n->keys, n->n, lo, 0); i < n->n && n->keys[i] <= hi; i++)
+    {
+        if (callback)
+            callback(n->keys[i], n->ptr[i], arg);
+        count++;
+    }
+    return count;
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+betree *bet_init(void (*callback)(void*))
+{
+    betree *t = malloc(sizeof *t);
+
+    if (!t)
+        return NULL;
+
+    t->callback = callback;
+    if (!(t->root = betnode_init(1)))
+    {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void bet_clear(betree *t)
+{
+    if (!t || !t->root)
+        return;
+
+    betnode_free(t, t->root);
+    t->root = betnode_init(1);
+}
+
+void bet_free(betree *t)
+{
+    if (!t)
+        return;
+
+    if (t->root)
+        betnode_free(t, t->root);
+    free(t);
+}
+
+int bet_insert(betree *t, long key, void *data)
+{
+    return bet_update(t, key, data, BET_PUT);
+}
+
+int bet_remove(betree *t, long key)
+{
+    return bet_update(t, key, NULL, BET_DEL);
+}
+
+int bet_contains(betree *t, long key)
+{
+    void *data;
+    return bet_find(t, key, &data);
+}
+
+void *bet_get(betree *t, long key)
+{
+    void *data;
+    return (bet_find(t, key, &data)) ? data : NULL;
+}
+
+size_t bet_range(betree *t, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    if (!t || !t->root || lo > hi)
+        return 0;
+
+    if (bet_push_range(t, t->root, lo, hi))
+        return (size_t)-1;
+    bet_fix_root(t);
+
+    return bet_range_node(t->root, lo, hi, callback, arg);
+}
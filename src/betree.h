@@ -0,0 +1,106 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BETREE_H
+#define BETREE_H
+
+/* write-optimized ordered map with long keys (B^epsilon-tree): inner
+ * nodes buffer pending inserts and removals, which move down in batches
+ * when a buffer is full. An update is a sorted insert into the root's
+ * buffer, and every node is touched once per batch instead of once per
+ * update. Same lookup interface as bst */
+
+#include <stddef.h>
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* maximum number of items per leaf and children per inner node, and
+ * number of buffered updates per inner node */
+#ifndef BET_LEAF
+#define BET_LEAF 64
+#endif
+#ifndef BET_FANOUT
+#define BET_FANOUT 16
+#endif
+#ifndef BET_BUFFER
+#define BET_BUFFER 256
+#endif
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct betree betree;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* initialize tree; callback(data) is called on data that is replaced or
+ * removed, if not NULL. As updates are buffered, that may happen later */
+betree *bet_init(void (*callback)(void*));
+
+/* remove all items from tree, calling the callback on them */
+void bet_clear(betree *t);
+
+/* free a tree, calling the callback on all items */
+void bet_free(betree *t);
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* insert an item, replacing an item with equal key; since that would
+ * take a lookup, existing keys aren't reported. returns -1 on allocation
+ * failure */
+int bet_insert(betree *t, long key, void *data);
+
+/* delete item with equal key, if any; returns -1 on allocation failure */
+int bet_remove(betree *t, long key);
+
+/* return non-zero if there's an item with equal key in tree */
+int bet_contains(betree *t, long key);
+
+/* get item with equal key */
+void *bet_get(betree *t, long key);
+
+/* call callback(key, data, arg) on all items with lo <= key <= hi in
+ * ascending order; returns the number of items. Buffered updates in the
+ * range are applied first, if that fails (size_t)-1 is returned */
+size_t bet_range(betree *t, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg);
+
+#endif
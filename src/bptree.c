@@ -0,0 +1,494 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bptree.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* minimum number of keys/children of all nodes but the root */
+#define HALF (BPT_KEYS / 2)
+
+/* enough for 2^64 items even if BPT_KEYS is tiny */
+#define BPT_MAX_HEIGHT 64
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+/* a leaf holds n keys and their data in ptr. An inner node has n
+ * children in ptr; child i holds keys <= keys[i], the last child has no
+ * upper bound. Unused keys are LONG_MAX, so a search can always compare
+ * all BPT_KEYS keys without looking at n */
+typedef struct bptnode bptnode;
+struct bptnode
+{
+    long keys[BPT_KEYS];
+    void *ptr[BPT_KEYS];
+    int n;
+    /* next leaf, unused in inner nodes */
+    bptnode *next;
+};
+
+/* B+tree object, a pointer to it is the first argument to all bpt_ functions */
+struct bptree
+{
+    bptnode *root;
+    /* number of inner levels above the leaves */
+    int height;
+};
+
+/* inner node passed while descending and index of the child taken */
+struct bptpath
+{
+    bptnode *node;
+    int idx;
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* create an empty node */
+static bptnode *bptnode_init(void);
+
+/* free a node and all nodes below it recursively */
+static void bptnode_free(bptnode *n, int height, void (*callback)(void*));
+
+/* return number of keys < key, i.e. the position of key in a leaf or the
+ * child to descend to in an inner node */
+static int bpt_search(const long *keys, long key);
+
+/* return the leaf key belongs in; store the inner nodes in path if it's
+ * not NULL */
+static bptnode *bpt_descend(bptree *t, long key, struct bptpath *path);
+
+/* return the leaf containing key and store its position in *pos, or
+ * return NULL */
+static bptnode *bpt_find(bptree *t, long key, struct bptpath *path, int *pos);
+
+/* insert key at keys[i] and ptr at ptr[i] (leaf) or ptr[i+1] (inner node,
+ * where key is the separator of the child ptr[i]) */
+static void bptnode_put(bptnode *n, int i, long key, void *ptr, int leaf);
+
+/* remove keys[i] and ptr[i] (leaf) or ptr[i+1] (inner node) */
+static void bptnode_del(bptnode *n, int i, int leaf);
+
+/* move the upper half of a full node to the empty node right, return
+ * the separator of n */
+static long bptnode_split(bptnode *n, bptnode *right, int leaf);
+
+/* fix underflow of child i of p by merging it with a sibling or moving
+ * one key from the sibling */
+static void bpt_rebalance(bptnode *p, int i, int leaf);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static bptnode *bptnode_init(void)
+{
+    bptnode *n = malloc(sizeof *n);
+    int i;
+
+    if (!n)
+        return NULL;
+
+    for (i = 0; i < BPT_KEYS; i++)
+        n->keys[i] = LONG_MAX;
+    n->n = 0;
+    n->next = NULL;
+
+    return n;
+}
+
+static void bptnode_free(bptnode *n, int height, void (*callback)(void*))
+{
+    int i;
+
+    for (i = 0; i < n->n; i++)
+    {
+        if (height)
+            bptnode_free(n->ptr[i], height - 1, callback);
+        else if (callback)
+            callback(n->ptr[i]);
+    }
+    free(n);
+}
+
+static int bpt_search(const long *keys, long key)
+{
+    int i, c = 0;
+
+    /* no early exit: without branches the loop gets vectorized */
+    for (i = 0; i < BPT_KEYS; i++)
+        c += (keys[i] < key);
+
+    return c;
+}
+
+static bptnode *bpt_descend(bptree *t, long key, struct bptpath *path)
+{
+    bptnode *n = t->root;
+    int level, i;
+
+    for (level = 0; level < t->height; level++)
+    {
+        i = bpt_search(n->keys, key);
+        if (path)
+        {
+            path[level].node = n;
+            path[level].idx = i;
+        }
+        n = n->ptr[i];
+    }
+    return n;
+}
+
+static bptnode *bpt_find(bptree *t, long key, struct bptpath *path, int *pos)
+{
+    bptnode *n;
+    int i;
+
+    if (!t || !t->root)
+        return NULL;
+
+    n = bpt_descend(t, key, path);
+    i = bpt_search(n->keys, key);
+
+    if (i >= n->n || n->keys[i] != key)
+        return NULL;
+
+    *pos = i;
+    return n;
+}
+
+static void bptnode_put(bptnode *n, int i, long key, void *ptr, int leaf)
+{
+    int p = (leaf) ? i : i + 1;
+
+    memmove(n->keys + i + 1, n->keys + i, (n->n - i) * sizeof *n->keys);
+    memmove(n->ptr + p + 1, n->ptr + p, (n->n - p) * sizeof *n->ptr);
+    n->keys[i] = key;
+    n->ptr[p] = ptr;
+    n->n++;
+}
+
+static void bptnode_del(bptnode *n, int i, int leaf)
+{
+    int p = (leaf) ? i : i + 1;
+
+    memmove(n->keys + i, n->keys + i + 1, (n->n - i - 1) * sizeof *n->keys);
+    memmove(n->ptr + p, n->ptr + p + 1, (n->n - p - 1) * sizeof *n->ptr);
+    n->n--;
+    n->keys[n->n] = LONG_MAX;
+}
+
+static long bptnode_split(bptnode *n, bptnode *right, int leaf)
+{
+    long sep = n->keys[HALF - 1];
+    int i;
+
+    memcpy(right->keys, n->keys + HALF, (BPT_KEYS - HALF) * sizeof *n->keys);
+    memcpy(right->ptr, n->ptr + HALF, (BPT_KEYS - HALF) * sizeof *n->ptr);
+    right->n = n->n - HALF;
+
+    for (i = HALF; i < BPT_KEYS; i++)
+        n->keys[i] = LONG_MAX;
+    n->n = HALF;
+
+    if (leaf)
+    {
+        right->next = n->next;
+        n->next = right;
+    }
+    else
+        /* the separator moves up to the parent */
+        n->keys[HALF - 1] = LONG_MAX;
+
+    return sep;
+}
+
+static void bpt_rebalance(bptnode *p, int i, int leaf)
+{
+    bptnode *l, *r;
+
+    /* l and r are adjacent children, separated by p->keys[i] */
+    if (i > 0)
+        i--;
+    l = p->ptr[i];
+    r = p->ptr[i + 1];
+
+    if (l->n + r->n <= BPT_KEYS)
+    {
+        /* merge r into l */
+        if (leaf)
+            l->next = r->next;
+        else
+            l->keys[l->n - 1] = p->keys[i];
+
+        memcpy(l->keys + l->n, r->keys, r->n * sizeof *r->keys);
+        memcpy(l->ptr + l->n, r->ptr, r->n * sizeof *r->ptr);
+        l->n += r->n;
+
+        bptnode_del(p, i, 0);
+        free(r);
+    }
+    else if (l->n > r->n)
+    {
+        /* move last key/child of l to r */
+        memmove(r->keys + 1, r->keys, r->n * sizeof *r->keys);
+        memmove(r->ptr + 1, r->ptr, r->n * sizeof *r->ptr);
+        r->keys[0] = (leaf) ? l->keys[l->n - 1] : p->keys[i];
+        r->ptr[0] = l->ptr[l->n - 1];
+        r->n++;
+
+        p->keys[i] = l->keys[l->n - 2];
+        l->n--;
+        l->keys[(leaf) ? l->n : l->n - 1] = LONG_MAX;
+    }
+    else
+    {
+        /* move first key/child of r to l */
+        l->keys[(leaf) ? l->n : l->n - 1] = (leaf) ? r->keys[0] : p->keys[i];
+        l->ptr[l->n] = r->ptr[0];
+        l->n++;
+
+        p->keys[i] = r->keys[0];
+        memmove(r->keys, r->keys + 1, (r->n - 1) * sizeof *r->keys);
+        memmove(r->ptr, r->ptr + 1, (r->n - 1) * sizeof *r->ptr);
+        r->n--;
+        r->keys[r->n] = LONG_MAX;
+    }
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+bptree *bpt_init(void)
+{
+    bptree *t = malloc(sizeof *t);
+    if (t)
+    {
+        t->root = NULL;
+        t->height = 0;
+    }
+    return t;
+}
+
+void bpt_clear(bptree *t, void (*callback)(void*))
+{
+    if (!t || !t->root)
+        return;
+
+    bptnode_free(t->root, t->height, callback);
+    t->root = NULL;
+    t->height = 0;
+}
+
+void bpt_free(bptree *t, void (*callback)(void*))
+{
+    bpt_clear(t, callback);
+    free(t);
+}
+
+int bpt_insert(bptree *t, long key, void *data)
+{
+    struct bptpath path[BPT_MAX_HEIGHT];
+    bptnode *spare[BPT_MAX_HEIGHT + 1];
+    bptnode *n, *f;
+    void *ptr = data;
+    int level, i, s, n_spare, leaf;
+
+    if (!t->root && !(t->root = bptnode_init()))
+        return -1;
+
+    n = bpt_descend(t, key, path);
+    i = bpt_search(n->keys, key);
+
+    /* no duplicates allowed */
+    if (i < n->n && n->keys[i] == key)
+        return -1;
+
+    /* every full node on the path gets split, plus a new root if all are
+     * full. Allocate the nodes beforehand, so that failing leaves the tree
+     * unchanged */
+    for (n_spare = 0; n_spare <= t->height; n_spare++)
+    {
+        f = (n_spare) ? path[t->height - n_spare].node : n;
+        if (f->n < BPT_KEYS)
+            break;
+    }
+    if (n_spare > t->height)
+        n_spare++;
+
+    for (s = 0; s < n_spare; s++)
+    {
+        if (!(spare[s] = bptnode_init()))
+        {
+            while (s--)
+                free(spare[s]);
+            return -1;
+        }
+    }
+
+    s = 0;
+    leaf = 1;
+    for (level = t->height; ; level--)
+    {
+        long sep;
+        bptnode *right;
+
+        if (n->n < BPT_KEYS)
+        {
+            bptnode_put(n, i, key, ptr, leaf);
+            break;
+        }
+
+        right = spare[s++];
+        sep = bptnode_split(n, right, leaf);
+        if (i < HALF)
+            bptnode_put(n, i, key, ptr, leaf);
+        else
+            bptnode_put(right, i - HALF, key, ptr, leaf);
+
+        /* new root */
+        if (!level)
+        {
+            f = spare[s++];
+            f->keys[0] = sep;
+            f->ptr[0] = n;
+            f->ptr[1] = right;
+            f->n = 2;
+            t->root = f;
+            t->height++;
+            break;
+        }
+
+        /* insert separator and right half into the parent */
+        key = sep;
+        ptr = right;
+        leaf = 0;
+        n = path[level - 1].node;
+        i = path[level - 1].idx;
+    }
+
+    return 0;
+}
+
+int bpt_remove(bptree *t, long key, void (*callback)(void*))
+{
+    struct bptpath path[BPT_MAX_HEIGHT];
+    bptnode *n;
+    int level, i;
+
+    if (!(n = bpt_find(t, key, path, &i)))
+        return -1;
+
+    if (callback) callback(n->ptr[i]);
+    bptnode_del(n, i, 1);
+
+    for (level = t->height; level > 0 && n->n < HALF; level--)
+    {
+        n = path[level - 1].node;
+        bpt_rebalance(n, path[level - 1].idx, level == t->height);
+    }
+
+    /* root has a single child or no key left */
+    if (t->height && t->root->n == 1)
+    {
+        n = t->root;
+        t->root = n->ptr[0];
+        t->height--;
+        free(n);
+    }
+    else if (!t->height && !t->root->n)
+    {
+        free(t->root);
+        t->root = NULL;
+    }
+
+    return 0;
+}
+
+int bpt_contains(bptree *t, long key)
+{
+    int i;
+    return (bpt_find(t, key, NULL, &i) != NULL);
+}
+
+void *bpt_get(bptree *t, long key)
+{
+    bptnode *n;
+    int i;
+
+    if (!(n = bpt_find(t, key, NULL, &i)))
+        return NULL;
+
+    return n->ptr[i];
+}
+
+size_t bpt_range(bptree *t, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    bptnode *n;
+    size_t count = 0;
+    int i;
+
+    if (!t || !t->root)
+        return 0;
+
+    n = bpt_descend(t, lo, NULL);
+    i = bpt_search(n->keys, lo);
+
+    /* the first key >= lo might be in the next leaf */
+    for (; n; n = n->next, i = 0)
+    {
+        for (; i < n->n; i++)
+        {
+            if (n->keys[i] > hi)
+                return count;
+
+            if (callback)
+                callback(n->keys[i], n->ptr[i], arg);
+            count++;
+        }
+    }
+    return count;
+}
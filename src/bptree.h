@@ -0,0 +1,95 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BPTREE_H
+#define BPTREE_H
+
+/* B+tree ordered map with long keys; same interface as bst, but with wide
+ * nodes and linked leaves so lookups touch few cache lines */
+
+#include <stddef.h>
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* maximum number of keys per node; nodes are split in halves, so this
+ * should be even. Keys are searched linearly, so that the compiler can
+ * vectorize the comparisons */
+#ifndef BPT_KEYS
+#define BPT_KEYS 32
+#endif
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct bptree bptree;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* initialize B+tree */
+bptree *bpt_init(void);
+
+/* remove all items from tree; leaves an empty tree */
+void bpt_clear(bptree *t, void (*callback)(void*));
+
+/* free a B+tree */
+void bpt_free(bptree *t, void (*callback)(void*));
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* insert an item into the tree; returns -1 if an item with equal key
+ * exists or on allocation failure */
+int bpt_insert(bptree *t, long key, void *data);
+
+/* delete item with equal key from tree */
+int bpt_remove(bptree *t, long key, void (*callback)(void*));
+
+/* return non-zero if there's an item with equal key in tree */
+int bpt_contains(bptree *t, long key);
+
+/* get item with equal key */
+void *bpt_get(bptree *t, long key);
+
+/* call callback(key, data, arg) on all items with lo <= key <= hi in
+ * ascending order; returns the number of items */
+size_t bpt_range(bptree *t, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg);
+
+#endif
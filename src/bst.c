@@ -25,6 +25,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "bst.h"
 
 #include <stdlib.h>
+#include <limits.h>
+
+#if __STDC_VERSION__ >= 199901L
+#include <stdint.h>
+typedef uintptr_t bstptr;
+#else
+typedef unsigned long bstptr;
+#endif
 
 
 /***********/
@@ -37,18 +45,49 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define RED 0
 #define BLACK 1
-#define LEAF 2
 
-#define IS_LEAF(n) ((n)->color == LEAF)
-#define IS_BLACK(n) (IS_LEAF(n) || (n)->color == BLACK)
-#define IS_RED(n) ((n)->color == RED)
+/* the color is stored in the lowest bit of the parent pointer */
+#define PARENT(n) ((bstnode*)((n)->parent & ~(bstptr)1))
+#define COLOR(n) ((int)((n)->parent & 1))
+#define SET_PARENT(n, p) ((n)->parent = (bstptr)(p) | ((n)->parent & 1))
+#define SET_COLOR(n, c) ((n)->parent = ((n)->parent & ~(bstptr)1) | (bstptr)(c))
+
+/* only the shared leaf (and free nodes) have no children */
+#define IS_LEAF(n) ((n)->left == NULL)
+#define IS_BLACK(n) (COLOR(n) == BLACK)
+#define IS_RED(n) (COLOR(n) == RED)
+
+#define IS_LEFT_CHILD(n) ((n) == PARENT(n)->left)
+#define IS_RIGHT_CHILD(n) ((n) == PARENT(n)->right)
+
+#define SIBLING(n) ((!(n) || !PARENT(n)) ? NULL : ((IS_LEFT_CHILD(n)) ? PARENT(n)->right : PARENT(n)->left))
+#define UNCLE(n) ((!(n) || !PARENT(n)) ? NULL : SIBLING(PARENT(n)))
+#define GRANDPARENT(n) (PARENT(PARENT(n)))
+
+/* child of p other than n; unlike SIBLING(), this works if n is the leaf */
+#define OTHER_CHILD(p, n) (((n) == (p)->left) ? (p)->right : (p)->left)
+
+/* number of nodes in the first and the largest arena chunks */
+#define BST_CHUNK_MIN 8
+#define BST_CHUNK_MAX 4096
+
+/* nodes of a chunk are stored right behind it */
+#define CHUNK_NODE(c, i) ((bstnode*)((char*)((c) + 1) + (i) * (c)->node_size))
+
+/* aggregate stored in a node of an augmented tree, see struct bstaugnode */
+#define NODE_AGG(n) (((struct bstaugnode*)(n))->agg)
 
-#define IS_LEFT_CHILD(n) ((n) == (n)->parent->left)
-#define IS_RIGHT_CHILD(n) ((n) == (n)->parent->right)
+/* aggregate of a subtree, see bst_augment() */
+#define AGG(t, n) (IS_LEAF(n) ? (t)->identity : NODE_AGG(n))
 
-#define SIBLING(n) ((!(n) || !(n)->parent) ? NULL : ((IS_LEFT_CHILD(n)) ? (n)->parent->right : (n)->parent->left))
-#define UNCLE(n) ((!(n) || !(n)->parent) ? NULL : SIBLING((n)->parent))
-#define GRANDPARENT(n) ((n)->parent->parent)
+/* upper bound for the height of a red-black tree with 2^64 nodes */
+#define BST_MAX_HEIGHT 128
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
 
 
 
@@ -61,142 +100,648 @@ typedef struct bstnode bstnode;
 struct bstnode
 {
     long key;
-    int color;
     void *data;
-    bstnode *parent;
+    /* number of nodes in the subtree rooted here, 0 for the leaf */
+    size_t size;
+    /* number of pointers to this node from other nodes and tree roots;
+     * nodes shared with a snapshot have refs > 1 */
+    size_t refs;
+    /* parent pointer and color, see PARENT() and COLOR(). Both refer to
+     * the live tree and are never used by snapshots, so they may change
+     * even if the node is shared */
+    bstptr parent;
     bstnode *left;
+    /* next free node if left is NULL */
     bstnode *right;
 };
 
+/* node with the aggregate of the values in its subtree. Only trees that
+ * called bst_augment() allocate these, the others don't pay for it */
+struct bstaugnode
+{
+    bstnode n;
+    long agg;
+};
+
+/* block of nodes; all nodes of a tree are allocated from its arena's
+ * chunks */
+struct bstchunk
+{
+    struct bstchunk *next;
+    size_t n_nodes;
+    size_t used;
+    /* sizeof(bstnode) or sizeof(struct bstaugnode) */
+    size_t node_size;
+};
+
+/* node storage of a tree, shared with the trees split off it */
+struct bstarena
+{
+    /* number of trees and merged arenas pointing here */
+    size_t refs;
+    /* the arena this one was merged into by bst_join(), or NULL */
+    struct bstarena *up;
+    /* most recently allocated chunk first */
+    struct bstchunk *chunks;
+    struct bstchunk *last;
+    /* removed nodes, linked via right */
+    bstnode *free;
+    bstnode *free_last;
+    /* node size of new chunks; sizeof(struct bstaugnode) only if all
+     * nodes of the arena have room for an aggregate */
+    size_t node_size;
+};
+
+/* key and data passed to bst_insert_many(), or key and position of a key
+ * passed to bst_get_many() */
+struct bstitem
+{
+    long key;
+    void *data;
+    /* position in the batch, keeps equal keys in order */
+    size_t i;
+};
+
 /* bst object, a pointer to it is the first argument to all bst_ functions */
 struct bst
 {
-    int (*cmp)(long, long);
     bstnode *root;
+    struct bstarena *arena;
+    int options;
+
+    /* aggregate function and item values, see bst_augment() */
+    long identity;
+    long (*combine)(long, long);
+    long (*value)(long, void*);
+
+    /* number of snapshots not reclaimed yet */
+    size_t snapshots;
+    /* released snapshots, reclaimed by the next update of the tree */
+    bst *volatile dead;
+    /* snapshots only: the tree it was taken from and the next released
+     * snapshot */
+    bst *origin;
+    bst *next;
 };
 
 
+/*===========*/
+/* variables */
+/*===========*/
+
+/* shared leaf of all trees; it's never modified */
+static bstnode bst_nil = { -1, NULL, 0, 0, BLACK, NULL, NULL };
+
+
+/* see bstmonoid_sum etc. */
+static long bst_add(long a, long b);
+static long bst_smaller(long a, long b);
+static long bst_greater(long a, long b);
+
+const bstmonoid bstmonoid_sum = { 0, bst_add };
+const bstmonoid bstmonoid_min = { LONG_MAX, bst_smaller };
+const bstmonoid bstmonoid_max = { LONG_MIN, bst_greater };
+
+
 /*===================*/
 /* static prototypes */
 /*===================*/
 
+/* make sure the next n_nodes nodes can be taken from the current chunk,
+ * adding a chunk of at least n_nodes nodes if necessary */
+static int bst_reserve(bst *t, size_t n_nodes);
+
 /* create a new bst node */
-static bstnode *bstnode_init(long key, void *data, bstnode *parent);
+static bstnode *bstnode_init(bst *t, long key, void *data, bstnode *parent);
+
+/* put a node on the free list */
+static void bstnode_release(bst *t, bstnode *n);
+
+/* drop a reference to an arena, freeing it if it isn't used anymore */
+static void bstarena_unref(struct bstarena *a);
 
-/* free a bst node and all it's descendants recursively */
-static void bstnode_free(bstnode *n, void (*callback)(void*));
+/* move all nodes of arena b to a and let b point to a */
+static void bstarena_merge(struct bstarena *a, struct bstarena *b);
+
+/* recompute n's aggregate from its children */
+static void bstnode_update(bst *t, bstnode *n);
+
+/* recompute all aggregates in the subtree rooted at n */
+static void bstnode_update_all(bst *t, bstnode *n);
+
+/* move t's items to a new arena whose nodes have room for an aggregate */
+static int bst_widen(bst *t);
+
+/* drop a reference to n, freeing all nodes that aren't referenced anymore */
+static void bstnode_unref(bst *t, bstnode *n);
+
+/* if n (whose parent isn't shared) is shared with a snapshot, replace it
+ * by a copy; return n or the copy */
+static bstnode *bst_own(bst *t, bstnode *n);
+
+/* make sure neither n nor any of its ancestors is shared */
+static bstnode *bst_own_path(bst *t, bstnode *n);
+
+/* put a released snapshot on o's dead list */
+static void bst_dead_push(bst *o, bst *s);
+
+/* empty t's dead list and return its former head */
+static bst *bst_dead_take(bst *t);
+
+/* prepare t for an update: find its arena, reclaim released snapshots
+ * and, if there are snapshots left, reserve the nodes needed for copying */
+static int bst_prepare(bst *t);
 
 /* find node in tree */
 static bstnode *bst_findpath(bstnode *n, long key);
 
-/* repair after inserting a node */
-static void bst_insert_repair(bst *t, bstnode *n);
+/* find the node a new item would be attached to, behind all items with
+ * equal key */
+static bstnode *bst_findleaf(bstnode *n, long key);
+
+/* repair after inserting a node; returns 1 if the black height of the
+ * tree grew */
+static int bst_insert_repair(bst *t, bstnode *n);
 
 /* remove one/all nodes with equal key */
 static void bst_remove_at(bst *t, bstnode *n);
-/* repair after removing a node */
-static void bst_remove_repair(bst *t, bstnode *n);
+/* repair after removing a node; n took its place below p */
+static void bst_remove_repair(bst *t, bstnode *n, bstnode *p);
 
 static void bst_rotate_left(bst *t, bstnode *n);
 static void bst_rotate_right(bst *t, bstnode *n);
 
+/* in-order successor/predecessor of a node, NULL if there is none */
+static bstnode *bstnode_next(bstnode *n);
+static bstnode *bstnode_prev(bstnode *n);
+
+/* first node with key >= key / last node with key <= key, or NULL */
+static bstnode *bst_lower(bst *t, long key);
+static bstnode *bst_upper(bst *t, long key);
+
+/* link n nodes sorted by key into a subtree of minimal height; nodes at
+ * depth red_depth become red, all others black */
+static bstnode *bst_build(bst *t, bstnode **nodes, size_t n,
+        bstnode *parent, int depth, int red_depth);
+
+/* replace t's nodes with n nodes sorted by key */
+static void bst_link(bst *t, bstnode **nodes, size_t n);
+
+/* compare struct bstitem by key (for qsort()) */
+static int bstitem_cmp(const void *a, const void *b);
+
+/* return the number of items with a key <= key */
+static size_t bst_rank_upper(bst *t, long key);
+
+/* number of keys < key in the ascending keys[0..n) */
+static size_t bst_bisect(const long *keys, size_t n, long key);
+
+/* bst_get_many() for ascending keys in the subtree rooted at n */
+static size_t bst_get_sorted(bst *t, bstnode *n, const long *keys,
+        void **out, size_t k);
+
+/* number of black nodes on a path from n to the leaf */
+static int bst_black_height(bstnode *n);
+
+/* join l and r (black roots without parent, black heights hl and hr) with
+ * m in between; the result is stored in t->root, its black height is
+ * returned */
+static int bst_join3(bst *t, bstnode *l, int hl, bstnode *m,
+        bstnode *r, int hr);
+
 
 /********************/
 /* STATIC FUNCTIONS */
 /*******************/
 
-static bstnode *bstnode_init(long key, void *data, bstnode *parent)
+static int bst_reserve(bst *t, size_t n_nodes)
+{
+    struct bstarena *a = t->arena;
+    struct bstchunk *c = a->chunks;
+    size_t size;
+
+    if (c && c->n_nodes - c->used >= n_nodes)
+        return 0;
+
+    /* chunks double in size up to BST_CHUNK_MAX nodes */
+    size = (c) ? 2 * c->n_nodes : BST_CHUNK_MIN;
+    if (size > BST_CHUNK_MAX)
+        size = BST_CHUNK_MAX;
+    if (size < n_nodes)
+        size = n_nodes;
+
+    if (!(c = malloc(sizeof *c + size * a->node_size)))
+        return -1;
+
+    if (!a->chunks)
+        a->last = c;
+    c->next = a->chunks;
+    c->n_nodes = size;
+    c->used = 0;
+    c->node_size = a->node_size;
+    a->chunks = c;
+
+    return 0;
+}
+
+static bstnode *bstnode_init(bst *t, long key, void *data, bstnode *parent)
 {
-    bstnode *n, *l, *r;
-    n = malloc(sizeof *n);
-    l = malloc(sizeof *n);
-    r = malloc(sizeof *n);
+    struct bstarena *a = t->arena;
+    bstnode *n;
 
-    if (!n || !l || !r)
+    if (a->free)
     {
-        free(n);
-        free(l);
-        free(r);
-        return NULL;
+        n = a->free;
+        a->free = n->right;
+    }
+    else
+    {
+        if (bst_reserve(t, 1))
+            return NULL;
+
+        n = CHUNK_NODE(a->chunks, a->chunks->used);
+        a->chunks->used++;
     }
 
     n->key = key;
-    n->color = RED;
     n->data = data;
-    n->parent = parent;
+    n->size = 1;
+    if (t->combine)
+        NODE_AGG(n) = t->value(key, data);
+    n->refs = 1;
+    n->parent = (bstptr)parent | RED;
 
-    n->left = l;
-    n->right = r;
-    l->color = r->color = LEAF;
-    l->key = r->key = -1;
-    l->parent = r->parent = n;
+    n->left = &bst_nil;
+    n->right = &bst_nil;
 
     return n;
 }
 
-static void bstnode_free(bstnode *n, void (*callback)(void*))
+static void bstnode_release(bst *t, bstnode *n)
 {
-    if (!n)
+    struct bstarena *a = t->arena;
+
+    if (!a->free)
+        a->free_last = n;
+    n->left = NULL;
+    n->right = a->free;
+    a->free = n;
+}
+
+static long bst_add(long a, long b)
+{
+    return a + b;
+}
+
+static long bst_smaller(long a, long b)
+{
+    return (a < b) ? a : b;
+}
+
+static long bst_greater(long a, long b)
+{
+    return (a > b) ? a : b;
+}
+
+static void bstnode_update(bst *t, bstnode *n)
+{
+    if (!t->combine)
+        return;
+
+    NODE_AGG(n) = t->combine(t->combine(AGG(t, n->left),
+                t->value(n->key, n->data)), AGG(t, n->right));
+}
+
+static void bstnode_update_all(bst *t, bstnode *n)
+{
+    if (IS_LEAF(n))
         return;
 
-    if (!IS_LEAF(n))
+    bstnode_update_all(t, n->left);
+    bstnode_update_all(t, n->right);
+    bstnode_update(t, n);
+}
+
+static int bst_widen(bst *t)
+{
+    struct bstarena *a, *old = t->arena;
+    bstnode **nodes, *n;
+    size_t i = 0, size = bst_size(t);
+
+    if (!(a = malloc(sizeof *a)))
+        return -1;
+    if (!(nodes = malloc((size + 1) * sizeof *nodes)))
     {
-        bstnode_free(n->left, callback);
-        bstnode_free(n->right, callback);
+        free(a);
+        return -1;
+    }
 
-        if (callback)
-            callback(n->data);
+    a->refs = 1;
+    a->up = NULL;
+    a->chunks = NULL;
+    a->last = NULL;
+    a->free = NULL;
+    a->free_last = NULL;
+    a->node_size = sizeof(struct bstaugnode);
+
+    t->arena = a;
+    if (bst_reserve(t, size))
+    {
+        t->arena = old;
+        bstarena_unref(a);
+        free(nodes);
+        return -1;
+    }
+
+    if (t->root)
+    {
+        for (n = t->root; !IS_LEAF(n->left); n = n->left)
+            ;
+        for (; n; n = bstnode_next(n))
+            nodes[i++] = n;
+    }
+
+    /* trees split off t may still use the old arena, so give the nodes
+     * back to it (releasing keeps key and data) */
+    t->arena = old;
+    if (old->refs > 1)
+    {
+        for (i = 0; i < size; i++)
+            bstnode_release(t, nodes[i]);
     }
-    free(n);
+
+    t->arena = a;
+    for (i = 0; i < size; i++)
+        nodes[i] = bstnode_init(t, nodes[i]->key, nodes[i]->data, NULL);
+    bst_link(t, nodes, size);
+
+    bstarena_unref(old);
+    free(nodes);
+    return 0;
 }
 
-static bstnode *bst_findpath(bstnode *n, long key)
+static void bstarena_unref(struct bstarena *a)
+{
+    struct bstarena *up;
+    struct bstchunk *c;
+
+    for (; a && !--a->refs; a = up)
+    {
+        up = a->up;
+        while ((c = a->chunks))
+        {
+            a->chunks = c->next;
+            free(c);
+        }
+        free(a);
+    }
+}
+
+static void bstarena_merge(struct bstarena *a, struct bstarena *b)
+{
+    /* nodes without room for an aggregate may now be taken from a */
+    if (b->node_size < a->node_size)
+        a->node_size = b->node_size;
+
+    /* a's first chunk stays the one nodes are taken from */
+    if (b->chunks)
+    {
+        if (a->chunks)
+            a->last->next = b->chunks;
+        else
+            a->chunks = b->chunks;
+        a->last = b->last;
+    }
+    if (b->free)
+    {
+        if (!a->free)
+            a->free_last = b->free_last;
+        b->free_last->right = a->free;
+        a->free = b->free;
+    }
+
+    b->chunks = NULL;
+    b->free = NULL;
+    b->up = a;
+    a->refs++;
+}
+
+static void bstnode_unref(bst *t, bstnode *n)
+{
+    bstnode *work;
+
+    if (!n || IS_LEAF(n) || --n->refs)
+        return;
+
+    /* nodes to free, linked via data */
+    n->data = NULL;
+    for (work = n; work; )
+    {
+        n = work;
+        work = n->data;
+
+        if (!IS_LEAF(n->left) && !--n->left->refs)
+        {
+            n->left->data = work;
+            work = n->left;
+        }
+        if (!IS_LEAF(n->right) && !--n->right->refs)
+        {
+            n->right->data = work;
+            work = n->right;
+        }
+        bstnode_release(t, n);
+    }
+}
+
+static bstnode *bst_own(bst *t, bstnode *n)
 {
-    if (key == n->key)
+    bstnode *c, *p;
+
+    if (IS_LEAF(n) || n->refs == 1)
         return n;
-    else if (key < n->key)
-        return (IS_LEAF(n->left)) ? n : bst_findpath(n->left, key);
+
+    /* can't fail, see bst_prepare() */
+    c = bstnode_init(t, n->key, n->data, NULL);
+    c->size = n->size;
+    if (t->combine)
+        NODE_AGG(c) = NODE_AGG(n);
+    c->parent = n->parent;
+    c->left = n->left;
+    c->right = n->right;
+
+    if (!IS_LEAF(c->left))
+    {
+        c->left->refs++;
+        SET_PARENT(c->left, c);
+    }
+    if (!IS_LEAF(c->right))
+    {
+        c->right->refs++;
+        SET_PARENT(c->right, c);
+    }
+
+    if (!(p = PARENT(n)))
+        t->root = c;
+    else if (p->left == n)
+        p->left = c;
     else
-        return (IS_LEAF(n->right)) ? n : bst_findpath(n->right, key);
+        p->right = c;
+
+    n->refs--;
+    return c;
 }
 
-static void bst_insert_repair(bst *t, bstnode *n)
+static bstnode *bst_own_path(bst *t, bstnode *n)
 {
-    bstnode *u;
+    bstnode *path[BST_MAX_HEIGHT];
+    int depth = 0;
+
+    if (!t->snapshots)
+        return n;
+
+    for (; n; n = PARENT(n))
+        path[depth++] = n;
+
+    /* top-down, so that every node's parent is owned already */
+    while (depth--)
+        n = bst_own(t, path[depth]);
+
+    return n;
+}
+
+/* the dead list is pushed to by any thread and emptied by the one updating
+ * the tree. Without GNU C atomic builtins, snapshots may only be released
+ * by the thread updating the tree */
+static void bst_dead_push(bst *o, bst *s)
+{
+#ifdef __GNUC__
+    do
+        s->next = o->dead;
+    while (!__sync_bool_compare_and_swap(&o->dead, s->next, s));
+#else
+    s->next = o->dead;
+    o->dead = s;
+#endif
+}
 
-    /* case 1: n is the root */
-    if (!n->parent)
+static bst *bst_dead_take(bst *t)
+{
+#ifdef __GNUC__
+    return __sync_lock_test_and_set(&t->dead, NULL);
+#else
+    bst *s = t->dead;
+
+    t->dead = NULL;
+    return s;
+#endif
+}
+
+static int bst_prepare(bst *t)
+{
+    struct bstarena *a;
+    bst *s, *next;
+    size_t height;
+
+    /* the arena may have been merged into another one */
+    if (t->arena->up)
     {
-        n->color = BLACK;
-        return;
+        for (a = t->arena; a->up; a = a->up)
+            ;
+        a->refs++;
+        bstarena_unref(t->arena);
+        t->arena = a;
     }
 
-    /* case 2: n's parent is black */
-    if (n->parent->color == BLACK)
-        return;
+    /* reclaim released snapshots */
+    if (t->dead)
+    {
+        for (s = bst_dead_take(t); s; s = next)
+        {
+            next = s->next;
+            bstnode_unref(t, s->root);
+            t->snapshots--;
+            free(s);
+        }
+    }
+
+    if (!t->snapshots)
+        return 0;
+
+    /* copying a path and the few nodes touched by rebalancing must not
+     * fail halfway */
+    for (height = 2; (bst_size(t) + 1) >> (height / 2); height += 2)
+        ;
+    return bst_reserve(t, 2 * height + 8);
+}
+
+static bstnode *bst_findpath(bstnode *n, long key)
+{
+    bstnode *next;
 
-    /* case 3: n's uncle and father are both red */
-    if ((u = UNCLE(n)) && u->color == RED)
+    while (key != n->key)
     {
-        n->parent->color = BLACK;
-        u->color = BLACK;
-        GRANDPARENT(n)->color = RED;
-        bst_insert_repair(t, GRANDPARENT(n));
-        return;
+        next = (key < n->key) ? n->left : n->right;
+        if (IS_LEAF(next))
+            break;
+        n = next;
+    }
+    return n;
+}
+
+static bstnode *bst_findleaf(bstnode *n, long key)
+{
+    bstnode *next;
+
+    for (;;)
+    {
+        next = (key < n->key) ? n->left : n->right;
+        if (IS_LEAF(next))
+            return n;
+        n = next;
+    }
+}
+
+static int bst_insert_repair(bst *t, bstnode *n)
+{
+    bstnode *u;
+
+    for (;;)
+    {
+        /* case 1: n is the root */
+        if (!PARENT(n))
+        {
+            SET_COLOR(n, BLACK);
+            return 1;
+        }
+
+        /* case 2: n's parent is black */
+        if (COLOR(PARENT(n)) == BLACK)
+            return 0;
+
+        /* case 3: n's uncle and father are both red; continue with the
+         * grandparent */
+        if (!(u = UNCLE(n)) || COLOR(u) != RED)
+            break;
+
+        SET_COLOR(PARENT(n), BLACK);
+        SET_COLOR(u, BLACK);
+        SET_COLOR(GRANDPARENT(n), RED);
+        n = GRANDPARENT(n);
     }
 
     /* case 4: n has no or black uncle, red father and
         either  n = n->parent->right && n->parent = n->parent->parent->left
         or      n = n->parent->left  && n->parent = n->parent->parent->right
     */
-    if (IS_RIGHT_CHILD(n) && IS_LEFT_CHILD(n->parent))
+    if (IS_RIGHT_CHILD(n) && IS_LEFT_CHILD(PARENT(n)))
     {
-        bst_rotate_left(t, n->parent);
+        bst_rotate_left(t, PARENT(n));
         n = n->left;
     }
-    else if (IS_LEFT_CHILD(n) && IS_RIGHT_CHILD(n->parent))
+    else if (IS_LEFT_CHILD(n) && IS_RIGHT_CHILD(PARENT(n)))
     {
-        bst_rotate_right(t, n->parent);
+        bst_rotate_right(t, PARENT(n));
         n = n->right;
     }
 
@@ -204,19 +749,20 @@ static void bst_insert_repair(bst *t, bstnode *n)
         either  n = n->parent->left  && n->parent = n->parent->parent->left
         or      n = n->parent->right && n->parent = n->parent->parent->right
     */
-    n->parent->color = BLACK;
-    GRANDPARENT(n)->color = RED;
+    SET_COLOR(PARENT(n), BLACK);
+    SET_COLOR(GRANDPARENT(n), RED);
     if (IS_LEFT_CHILD(n))
         bst_rotate_right(t, GRANDPARENT(n));
     else
     {
         bst_rotate_left(t, GRANDPARENT(n));
     }
+    return 0;
 }
 
 static void bst_remove_at(bst *t, bstnode *n)
 {
-    bstnode *p;
+    bstnode *p, *q, *r;
 
     /* n has two children */
     if (!IS_LEAF(n->left) && !IS_LEAF(n->right))
@@ -237,82 +783,98 @@ static void bst_remove_at(bst *t, bstnode *n)
                 p = p->left;
         }
 
+        /* n is owned already, see bst_remove() */
+        p = bst_own_path(t, p);
+
         /* swap key and data and remove swapped node (which has 0 or 1 child) */
         tmpkey = p->key, p->key = n->key, n->key = tmpkey;
         tmpdata = p->data, p->data = n->data, n->data = tmpdata;
-        bst_remove_at(t, p);
-        return;
+        n = p;
     }
 
     /* n has no/one child */
     p = IS_LEAF(n->left) ? n->right : n->left;
 
     /* replace n with p */
-    p->parent = n->parent;
-    if (n->parent)
+    q = PARENT(n);
+    if (!IS_LEAF(p))
+        SET_PARENT(p, q);
+    if (q)
     {
         if (IS_LEFT_CHILD(n))
-            n->parent->left = p;
+            q->left = p;
         else
-            n->parent->right = p;
+            q->right = p;
     }
     else
         t->root = p;
 
+    /* this includes the node that took n's item */
+    for (r = q; r; r = PARENT(r))
+    {
+        r->size--;
+        bstnode_update(t, r);
+    }
+
     if (IS_BLACK(n))
     {
-        if (p->color == RED)
-            p->color = BLACK;
+        if (COLOR(p) == RED)
+            SET_COLOR(p, BLACK);
         else
-            bst_remove_repair(t, p);
+            bst_remove_repair(t, p, q);
     }
-    free(n);
-    return;
+    bstnode_release(t, n);
 }
 
-static void bst_remove_repair(bst *t, bstnode *n)
+/* n may be the leaf, whose parent isn't maintained, so p is passed along */
+static void bst_remove_repair(bst *t, bstnode *n, bstnode *p)
 {
     bstnode *sib;
 
-    /* case 1: n is root */
-    if (!n->parent)
-        return;
+    for (;;)
+    {
+        /* case 1: n is root */
+        if (!p)
+            return;
 
-    sib = SIBLING(n);
+        sib = OTHER_CHILD(p, n);
 
-    /* case 2: n's sibling is red */
-    if (IS_RED(sib))
-    {
-        n->parent->color = RED;
-        sib->color = BLACK;
+        /* case 2: n's sibling is red */
+        if (IS_RED(sib))
+        {
+            SET_COLOR(p, RED);
+            SET_COLOR(sib, BLACK);
 
-        if (IS_LEFT_CHILD(n))
-            bst_rotate_left(t, n->parent);
-        else
-            bst_rotate_right(t, n->parent);
+            /* p is owned already, so it stays n's parent */
+            if (n == p->left)
+                bst_rotate_left(t, p);
+            else
+                bst_rotate_right(t, p);
 
-        sib = SIBLING(n);
-    }
+            sib = OTHER_CHILD(p, n);
+        }
 
-    /* case 3: parent sib and sib's children are black */
-    if (n->parent->color == BLACK &&
-        sib->color == BLACK &&
-        IS_BLACK(sib->left) &&
-        IS_BLACK(sib->right))
-    {
-        sib->color = RED;
-        bst_remove_repair(t, n->parent);
-        return;
+        /* case 3: parent sib and sib's children are black; continue with
+         * the parent */
+        if (COLOR(p) != BLACK ||
+            COLOR(sib) != BLACK ||
+            !IS_BLACK(sib->left) ||
+            !IS_BLACK(sib->right))
+            break;
+
+        SET_COLOR(sib, RED);
+        n = p;
+        p = PARENT(n);
     }
 
     /* case 4: parent is red, sib and sib's children are black */
-    if (n->parent->color == RED &&
-        sib->color == BLACK &&
+    if (COLOR(p) == RED &&
+        COLOR(sib) == BLACK &&
         IS_BLACK(sib->left) &&
         IS_BLACK(sib->right))
     {
-        sib->color = RED;
-        n->parent->color = BLACK;
+        SET_COLOR(sib, RED);
+        SET_COLOR(p, BLACK);
         return;
     }
 
@@ -320,39 +882,39 @@ static void bst_remove_repair(bst *t, bstnode *n)
         a) n is left child, sib and sib->right child are black, sib->left is red
         b) n is right child, sib and sib->left child are black, sib->right is red
     */
-    if (IS_LEFT_CHILD(n) &&
-        sib->color == BLACK &&
+    if (n == p->left &&
+        COLOR(sib) == BLACK &&
         IS_RED(sib->left) &&
         IS_BLACK(sib->right))
     {
-        sib->color = RED;
-        sib->left->color = BLACK;
+        SET_COLOR(sib, RED);
+        SET_COLOR(sib->left, BLACK);
         bst_rotate_right(t, sib);
-        sib = SIBLING(n);
+        sib = OTHER_CHILD(p, n);
     }
-    else if (IS_RIGHT_CHILD(n) &&
-        sib->color == BLACK &&
+    else if (n == p->right &&
+        COLOR(sib) == BLACK &&
         IS_RED(sib->right) && 
         IS_BLACK(sib->left))
     {
-        sib->color = RED;
-        sib->right->color = BLACK;
+        SET_COLOR(sib, RED);
+        SET_COLOR(sib->right, BLACK);
         bst_rotate_left(t, sib);
-        sib = SIBLING(n);
+        sib = OTHER_CHILD(p, n);
     }
 
     /* case 6: */ 
-    sib->color = n->parent->color;
-    n->parent->color = BLACK;
-    if (IS_LEFT_CHILD(n))
+    SET_COLOR(sib, COLOR(p));
+    SET_COLOR(p, BLACK);
+    if (n == p->left)
     {
-        sib->right->color = BLACK;
-        bst_rotate_left(t, n->parent);
+        SET_COLOR(sib->right, BLACK);
+        bst_rotate_left(t, p);
     }
     else
     {
-        sib->left->color = BLACK;
-        bst_rotate_right(t, n->parent);
+        SET_COLOR(sib->left, BLACK);
+        bst_rotate_right(t, p);
     }
 }
 
@@ -365,108 +927,636 @@ static void bst_rotate_##dir(bst *t, bstnode *n)    \
     if (!n || !n->other)                            \
         return;                                     \
                                                     \
-    p = n->other;                                   \
+    /* n's parent is never shared */                \
+    n = bst_own(t, n);                              \
+    p = bst_own(t, n->other);                       \
                                                     \
     if (n == t->root)                               \
     {                                               \
         t->root = p;                                \
-        p->parent = NULL;                           \
+        SET_PARENT(p, NULL);                        \
     }                                               \
     else                                            \
     {                                               \
         if (IS_LEFT_CHILD(n))                       \
-            n->parent->left = p;                    \
+            PARENT(n)->left = p;                    \
         else                                        \
-            n->parent->right = p;                   \
-        p->parent = n->parent;                      \
+            PARENT(n)->right = p;                   \
+        SET_PARENT(p, PARENT(n));                   \
     }                                               \
                                                     \
     n->other = p->dir;                              \
-    if (n->other)                                   \
-        n->other->parent = n;                       \
+    if (!IS_LEAF(n->other))                         \
+        SET_PARENT(n->other, n);                    \
     p->dir = n;                                     \
-    n->parent = p;                                  \
+    SET_PARENT(n, p);                               \
+                                                    \
+    p->size = n->size;                              \
+    n->size = n->left->size + n->right->size + 1;   \
+    bstnode_update(t, n);                           \
+    bstnode_update(t, p);                           \
 }
 
 ROTATE(left, right)
 ROTATE(right, left)
 
-/**********************/
-/* EXPORTED FUNCTIONS */
-/**********************/
 
-bst *bst_init(void)
-{
-    bst *t = malloc(sizeof *t);
-    if (t)
-    {
-        t->root = NULL;
-    }
-    return t;
+#define NEIGHBOUR(name, dir, other)                 \
+static bstnode *bstnode_##name(bstnode *n)          \
+{                                                   \
+    if (!IS_LEAF(n->dir))                           \
+    {                                               \
+        n = n->dir;                                 \
+        while (!IS_LEAF(n->other))                  \
+            n = n->other;                           \
+        return n;                                   \
+    }                                               \
+                                                    \
+    while (PARENT(n) && n == PARENT(n)->dir)        \
+        n = PARENT(n);                              \
+    return PARENT(n);                               \
 }
 
-void bst_free(bst *t, void (*callback)(void*))
-{
-    bst_clear(t, callback);
-    free(t);
-}
+NEIGHBOUR(next, right, left)
+NEIGHBOUR(prev, left, right)
 
-void bst_clear(bst *t, void (*callback)(void*))
+static bstnode *bst_lower(bst *t, long key)
 {
-    if (!t || !t->root)
-        return;
+    bstnode *n, *res = NULL;
 
-    bstnode_free(t->root, callback);
-    t->root = NULL;
-}
+    if (!t->root)
+        return NULL;
 
-int bst_empty(bst *t)
-{
-    return (t->root == NULL);
+    for (n = t->root; !IS_LEAF(n); )
+    {
+        if (n->key >= key)
+        {
+            res = n;
+            n = n->left;
+        }
+        else
+            n = n->right;
+    }
+    return res;
 }
 
-int bst_insert(bst *t, long key, void *data)
+static bstnode *bst_upper(bst *t, long key)
 {
-    bstnode *n;
-    bstnode *ins;
+    bstnode *n, *res = NULL;
 
-    if (t->root && IS_LEAF(t->root))
+    if (!t->root)
+        return NULL;
+
+    for (n = t->root; !IS_LEAF(n); )
+    {
+        if (n->key <= key)
+        {
+            res = n;
+            n = n->right;
+        }
+        else
+            n = n->left;
+    }
+    return res;
+}
+
+static bstnode *bst_build(bst *t, bstnode **nodes, size_t n,
+        bstnode *parent, int depth, int red_depth)
+{
+    bstnode *m;
+    size_t mid = n / 2;
+
+    if (!n)
+        return &bst_nil;
+
+    m = nodes[mid];
+    SET_PARENT(m, parent);
+    SET_COLOR(m, (depth == red_depth) ? RED : BLACK);
+    m->size = n;
+    m->left = bst_build(t, nodes, mid, m, depth + 1, red_depth);
+    m->right = bst_build(t, nodes + mid + 1, n - mid - 1, m, depth + 1, red_depth);
+    bstnode_update(t, m);
+
+    return m;
+}
+
+static void bst_link(bst *t, bstnode **nodes, size_t n)
+{
+    int h = 0;
+
+    if (!n)
     {
-        bstnode_free(t->root, NULL);
         t->root = NULL;
+        return;
     }
 
+    /* splitting at the middle fills all levels but the last one (at depth
+     * floor(log2(n))), so making that one red balances all black heights */
+    while ((size_t)2 << h <= n)
+        h++;
+
+    t->root = bst_build(t, nodes, n, NULL, 0, (h) ? h : -1);
+}
+
+static int bstitem_cmp(const void *a, const void *b)
+{
+    const struct bstitem *x = a, *y = b;
+
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+    return (x->i > y->i) - (x->i < y->i);
+}
+
+static size_t bst_bisect(const long *keys, size_t n, long key)
+{
+    size_t lo = 0, mid;
+
+    while (n)
+    {
+        mid = lo + n / 2;
+        if (keys[mid] < key)
+        {
+            lo = mid + 1;
+            n -= n / 2 + 1;
+        }
+        else
+            n /= 2;
+    }
+    return lo;
+}
+
+static size_t bst_get_sorted(bst *t, bstnode *n, const long *keys,
+        void **out, size_t k)
+{
+    bstnode *m, *first;
+    size_t lt, le, i, found = 0;
+
+    /* the keys left of n go down its left subtree, the ones right of it
+     * down its right subtree; so every node is visited at most once */
+    while (k)
+    {
+        if (IS_LEAF(n))
+        {
+            for (i = 0; i < k; i++)
+                out[i] = NULL;
+            break;
+        }
+
+        /* a single key is cheaper to find like bst_get() does */
+        if (k == 1 && !(t->options & BST_MULTI))
+        {
+            n = bst_findpath(n, *keys);
+            *out = (n->key == *keys) ? n->data : NULL;
+            return found + (n->key == *keys);
+        }
+
+        lt = bst_bisect(keys, k, n->key);
+        for (le = lt; le < k && keys[le] == n->key; le++)
+            ;
+
+        /* the right child is loaded while the left subtree is searched */
+        if (lt)
+        {
+            if (le < k)
+                PREFETCH(n->right);
+            found += bst_get_sorted(t, n->left, keys, out, lt);
+        }
+
+        if (lt < le)
+        {
+            /* the first of equal items may be further left */
+            first = n;
+            if (t->options & BST_MULTI)
+            {
+                for (m = n->left; !IS_LEAF(m); )
+                {
+                    if (m->key < n->key)
+                        m = m->right;
+                    else
+                    {
+                        first = m;
+                        m = m->left;
+                    }
+                }
+            }
+
+            for (i = lt; i < le; i++)
+                out[i] = first->data;
+            found += le - lt;
+        }
+
+        keys += le;
+        out += le;
+        k -= le;
+        n = n->right;
+    }
+    return found;
+}
+
+static size_t bst_rank_upper(bst *t, long key)
+{
+    bstnode *n;
+    size_t rank = 0;
+
+    if (!t || !t->root)
+        return 0;
+
+    for (n = t->root; !IS_LEAF(n); )
+    {
+        if (key < n->key)
+            n = n->left;
+        else
+        {
+            rank += n->left->size + 1;
+            n = n->right;
+        }
+    }
+    return rank;
+}
+
+static int bst_black_height(bstnode *n)
+{
+    int h = 0;
+
+    for (; n && !IS_LEAF(n); n = n->left)
+        h += IS_BLACK(n);
+    return h;
+}
+
+static int bst_join3(bst *t, bstnode *l, int hl, bstnode *m,
+        bstnode *r, int hr)
+{
+    bstnode *c, *p = NULL, *low;
+    int h, right = (hl >= hr);
+
+    /* descend the taller tree on the side facing the other one to the
+     * first black node of the same black height; m takes its place */
+    c = (right) ? l : r;
+    h = (right) ? hl : hr;
+    low = (right) ? r : l;
+    for (; IS_RED(c) || h > ((right) ? hr : hl);
+            c = (right) ? c->right : c->left)
+    {
+        h -= IS_BLACK(c);
+        p = c;
+    }
+
+    if (right)
+    {
+        m->left = c;
+        m->right = r;
+    }
+    else
+    {
+        m->left = l;
+        m->right = c;
+    }
+
+    m->parent = (bstptr)p | RED;
+    if (!IS_LEAF(m->left))
+        SET_PARENT(m->left, m);
+    if (!IS_LEAF(m->right))
+        SET_PARENT(m->right, m);
+    m->size = m->left->size + m->right->size + 1;
+    bstnode_update(t, m);
+
+    t->root = (right) ? l : r;
+    if (!p)
+        t->root = m;
+    else if (right)
+        p->right = m;
+    else
+        p->left = m;
+
+    for (; p; p = PARENT(p))
+    {
+        p->size += low->size + 1;
+        bstnode_update(t, p);
+    }
+
+    /* m is red and its children are black, so this is just like inserting
+     * it */
+    return ((right) ? hl : hr) + bst_insert_repair(t, m);
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+bst *bst_init(void)
+{
+    return bst_init_o(0);
+}
+
+bst *bst_init_o(int options)
+{
+    bst *t = malloc(sizeof *t);
+    if (t)
+    {
+        if (!(t->arena = malloc(sizeof *t->arena)))
+        {
+            free(t);
+            return NULL;
+        }
+        t->arena->refs = 1;
+        t->arena->up = NULL;
+        t->arena->chunks = NULL;
+        t->arena->last = NULL;
+        t->arena->free = NULL;
+        t->arena->free_last = NULL;
+        t->arena->node_size = sizeof(bstnode);
+
+        t->root = NULL;
+        t->options = options;
+
+        t->identity = 0;
+        t->combine = NULL;
+        t->value = NULL;
+
+        t->snapshots = 0;
+        t->dead = NULL;
+        t->origin = NULL;
+        t->next = NULL;
+    }
+    return t;
+}
+
+bst *bst_build_sorted(const long *keys, void **data, size_t n)
+{
+    return bst_build_sorted_o(keys, data, n, 0);
+}
+
+bst *bst_build_sorted_o(const long *keys, void **data, size_t n, int options)
+{
+    bst *t;
+    bstnode **nodes;
+    size_t i;
+
+    for (i = 1; i < n; i++)
+    {
+        if (keys[i - 1] > keys[i] ||
+                (keys[i - 1] == keys[i] && !(options & BST_MULTI)))
+            return NULL;
+    }
+
+    if (!(t = bst_init_o(options)) || !n)
+        return t;
+
+    if (bst_reserve(t, n) || !(nodes = malloc(n * sizeof *nodes)))
+    {
+        bst_free(t, NULL);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++)
+        nodes[i] = bstnode_init(t, keys[i], (data) ? data[i] : NULL, NULL);
+
+    bst_link(t, nodes, n);
+    free(nodes);
+    return t;
+}
+
+bst *bst_snapshot(bst *t)
+{
+    bst *s;
+
+    if (t->origin || bst_prepare(t) || !(s = malloc(sizeof *s)))
+        return NULL;
+
+    *s = *t;
+    s->origin = t;
+    s->next = NULL;
+
+    /* from now on, the root (and thus every node) is shared */
+    if (t->root)
+        t->root->refs++;
+    t->snapshots++;
+
+    return s;
+}
+
+int bst_split(bst *t, long key, bst **left, bst **right)
+{
+    bstnode *path[BST_MAX_HEIGHT], *n, *m, *l = &bst_nil, *r = &bst_nil;
+    int heights[BST_MAX_HEIGHT], depth = 0, h, hl = 0, hr = 0;
+    bst *s;
+
+    if (t->origin || bst_prepare(t) || t->snapshots ||
+            !(s = malloc(sizeof *s)))
+        return -1;
+
+    *s = *t;
+    s->root = NULL;
+    s->arena->refs++;
+
+    /* path to the leaf key would be inserted at */
+    h = bst_black_height(t->root);
+    for (n = t->root; n && !IS_LEAF(n); )
+    {
+        path[depth] = n;
+        heights[depth++] = h;
+        h -= IS_BLACK(n);
+        n = (key <= n->key) ? n->left : n->right;
+    }
+
+    /* bottom-up, join each node and its subtree off the path with the
+     * smaller (l) or greater (r) keys collected so far */
+    while (depth--)
+    {
+        m = path[depth];
+        n = (key <= m->key) ? m->right : m->left;
+        h = heights[depth] - IS_BLACK(m);
+
+        if (!IS_LEAF(n))
+        {
+            SET_PARENT(n, NULL);
+            if (IS_RED(n))
+            {
+                SET_COLOR(n, BLACK);
+                h++;
+            }
+        }
+
+        if (key <= m->key)
+        {
+            hr = bst_join3(t, r, hr, m, n, h);
+            r = t->root;
+        }
+        else
+        {
+            hl = bst_join3(t, n, h, m, l, hl);
+            l = t->root;
+        }
+    }
+
+    t->root = (IS_LEAF(l)) ? NULL : l;
+    s->root = (IS_LEAF(r)) ? NULL : r;
+
+    *left = t;
+    *right = s;
+    return 0;
+}
+
+int bst_join(bst *left, bst *right)
+{
+    bstnode *l, *m, *r;
+    long key, max;
+    void *data;
+
+    if (left == right || left->origin || right->origin ||
+            bst_prepare(left) || bst_prepare(right) ||
+            left->snapshots || right->snapshots ||
+            ((left->options ^ right->options) & BST_MULTI) ||
+            left->combine != right->combine || left->value != right->value)
+        return -1;
+
+    if (bst_max(left, &max, NULL) == 0 && bst_min(right, &key, NULL) == 0 &&
+            (max > key || (max == key && !(left->options & BST_MULTI))))
+        return -1;
+
+    if (left->arena != right->arena)
+        bstarena_merge(left->arena, right->arena);
+
+    /* the smallest item of right becomes the node joining the trees; it
+     * is put on the free list first, so allocating it can't fail */
+    if (bst_min(right, &key, &data) == 0)
+    {
+        bst_remove(right, key, NULL);
+        m = bstnode_init(left, key, data, NULL);
+
+        l = (left->root) ? left->root : &bst_nil;
+        r = (right->root) ? right->root : &bst_nil;
+        bst_join3(left, l, bst_black_height(l), m, r, bst_black_height(r));
+        right->root = NULL;
+    }
+
+    bst_free(right, NULL);
+    return 0;
+}
+
+void bst_free(bst *t, void (*callback)(void*))
+{
+    bst *o;
+
+    if (!t)
+        return;
+
+    /* snapshot: leave reclaiming to the next update of the tree */
+    if ((o = t->origin))
+    {
+        bst_dead_push(o, t);
+        return;
+    }
+
+    bst_clear(t, callback);
+    bstarena_unref(t->arena);
+    free(t);
+}
+
+void bst_clear(bst *t, void (*callback)(void*))
+{
+    struct bstarena *a;
+    struct bstchunk *c;
+    bstnode *n;
+    size_t i;
+
+    if (!t || t->origin)
+        return;
+
+    bst_prepare(t);
+    a = t->arena;
+
+    /* snapshots or other trees still use some nodes, so only drop the
+     * live tree's */
+    if (t->snapshots || a->refs > 1)
+    {
+        if (callback && t->root)
+        {
+            for (n = t->root; !IS_LEAF(n->left); n = n->left)
+                ;
+            for (; n; n = bstnode_next(n))
+                callback(n->data);
+        }
+
+        bstnode_unref(t, t->root);
+        t->root = NULL;
+        return;
+    }
+
+    while ((c = a->chunks))
+    {
+        /* skip free nodes */
+        for (i = 0; callback && i < c->used; i++)
+        {
+            n = CHUNK_NODE(c, i);
+            if (!IS_LEAF(n))
+                callback(n->data);
+        }
+
+        a->chunks = c->next;
+        free(c);
+    }
+
+    t->root = NULL;
+    a->free = NULL;
+}
+
+int bst_empty(bst *t)
+{
+    return (t->root == NULL);
+}
+
+size_t bst_size(bst *t)
+{
+    return (t && t->root) ? t->root->size : 0;
+}
+
+int bst_insert(bst *t, long key, void *data)
+{
+    bstnode *n;
+    bstnode *ins;
+
+    if (t->origin || bst_prepare(t))
+        return -1;
+
     if (!t->root)
     {
-        t->root = bstnode_init(key, data, NULL);
+        t->root = bstnode_init(t, key, data, NULL);
         if (!t->root)
             return -1;
 
-        t->root->color = BLACK;
+        SET_COLOR(t->root, BLACK);
         return 0;
     }
 
-    n = bst_findpath(t->root, key);
+    if (t->options & BST_MULTI)
+        n = bst_findleaf(t->root, key);
+    else
+    {
+        n = bst_findpath(t->root, key);
 
-    /* no duplicates allowed */
-    if (key == n->key)
-        return -1;
+        /* no duplicates allowed */
+        if (key == n->key)
+            return -1;
+    }
 
-    ins = bstnode_init(key, data, n);
+    n = bst_own_path(t, n);
+    ins = bstnode_init(t, key, data, n);
     if (!ins)
         return -1;
 
     /* new data smaller -> insert left */
     if (key < n->key)
-    {
-        free(n->left);
         n->left = ins;
-    }
-    /* new data greater -> insert right */
+    /* new data greater (or equal) -> insert right */
     else
-    {
-        free(n->right);
         n->right = ins;
+
+    for (; n; n = PARENT(n))
+    {
+        n->size++;
+        bstnode_update(t, n);
     }
 
     /* repair the tree */
@@ -475,29 +1565,152 @@ int bst_insert(bst *t, long key, void *data)
     return 0;
 }
 
+int bst_insert_many(bst *t, const long *keys, void **data, size_t n)
+{
+    struct bstitem *items;
+    bstnode **nodes, *first, *node;
+    size_t i, j, k, m, size = bst_size(t);
+
+    if (t->origin || bst_prepare(t))
+        return -1;
+
+    if (!n)
+        return 0;
+
+    /* rebuilding costs O(size), so insert a small batch one by one; the
+     * same goes for trees sharing their nodes with snapshots */
+    if (n < size / 16 || t->snapshots)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (bst_insert(t, keys[i], (data) ? data[i] : NULL) &&
+                    !bst_contains(t, keys[i]))
+                return -1;
+        }
+        return 0;
+    }
+
+    if (!(items = malloc(n * sizeof *items)))
+        return -1;
+
+    for (i = 0; i < n; i++)
+    {
+        items[i].key = keys[i];
+        items[i].data = (data) ? data[i] : NULL;
+        items[i].i = i;
+    }
+    qsort(items, n, sizeof *items, bstitem_cmp);
+
+    first = t->root;
+    if (first)
+    {
+        while (!IS_LEAF(first->left))
+            first = first->left;
+    }
+
+    /* drop keys that are in the tree already or repeated in the batch */
+    if (t->options & BST_MULTI)
+        m = n;
+    else
+    {
+        node = first;
+        for (i = m = 0; i < n; i++)
+        {
+            if (m && items[m - 1].key == items[i].key)
+                continue;
+
+            while (node && node->key < items[i].key)
+                node = bstnode_next(node);
+
+            if (!node || node->key != items[i].key)
+                items[m++] = items[i];
+        }
+    }
+
+    if (bst_reserve(t, m) || !(nodes = malloc((size + m) * sizeof *nodes)))
+    {
+        free(items);
+        return -1;
+    }
+
+    /* new nodes go to the end of the array, so that merging them with the
+     * tree's nodes can happen in place */
+    for (i = 0; i < m; i++)
+        nodes[size + i] = bstnode_init(t, items[i].key, items[i].data, NULL);
+    free(items);
+
+    /* equal keys of the tree come first */
+    node = first;
+    for (j = size, k = 0; k < size + m; k++)
+    {
+        if (j == size + m || (node && node->key <= nodes[j]->key))
+        {
+            nodes[k] = node;
+            node = bstnode_next(node);
+        }
+        else
+            nodes[k] = nodes[j++];
+    }
+
+    bst_link(t, nodes, size + m);
+    free(nodes);
+    return 0;
+}
+
 int bst_remove(bst *t, long key, void (*callback)(void*))
 {
     bstnode *del;
 
-    if (!t->root)
+    if (t->origin || bst_prepare(t) || !t->root)
         return -1;
 
-    del = bst_findpath(t->root, key);
+    if (t->options & BST_MULTI)
+        del = bst_lower(t, key);
+    else
+        del = bst_findpath(t->root, key);
 
-    if (key != del->key)
+    if (!del || key != del->key)
         return -1;
 
     if (callback) callback(del->data);
-    bst_remove_at(t, del);
+    bst_remove_at(t, bst_own_path(t, del));
+
+    /* removed the last node */
+    if (IS_LEAF(t->root))
+        t->root = NULL;
 
     return 0;
 }
 
+int bst_remove_data(bst *t, long key, void *data, void (*callback)(void*))
+{
+    bstnode *del;
+
+    if (t->origin || bst_prepare(t) || !t->root)
+        return -1;
+
+    for (del = bst_lower(t, key); del && key == del->key; del = bstnode_next(del))
+    {
+        if (del->data != data)
+            continue;
+
+        if (callback) callback(del->data);
+        bst_remove_at(t, bst_own_path(t, del));
+
+        /* removed the last node */
+        if (IS_LEAF(t->root))
+            t->root = NULL;
+
+        return 0;
+    }
+    return -1;
+}
+
 int bst_contains(bst *t, long key)
 {
     bstnode *n;
 
-    if (!t || !t->root || IS_LEAF(t->root))
+    if (!t || !t->root)
         return 0;
 
     n = bst_findpath(t->root, key);
@@ -509,13 +1722,413 @@ void *bst_get(bst *t, long key)
 {
     bstnode *n;
 
-    if (!t || !t->root || IS_LEAF(t->root))
+    if (!t || !t->root)
         return NULL;
 
-    n = bst_findpath(t->root, key);
+    if (t->options & BST_MULTI)
+        n = bst_lower(t, key);
+    else
+        n = bst_findpath(t->root, key);
 
-    if (key == n->key)
+    if (n && key == n->key)
         return n->data;
     else
         return NULL;
 }
+
+size_t bst_get_many(bst *t, const long *keys, size_t n, void **out)
+{
+    struct bstitem *items;
+    long *sorted;
+    void **res;
+    size_t i, found;
+
+    for (i = 1; i < n && keys[i - 1] <= keys[i]; i++)
+        ;
+
+    if (!t || !t->root || i >= n)
+    {
+        if (t && t->root)
+            return bst_get_sorted(t, t->root, keys, out, n);
+
+        for (i = 0; i < n; i++)
+            out[i] = NULL;
+        return 0;
+    }
+
+    /* sort the keys, remembering where they came from */
+    items = malloc(n * sizeof *items);
+    sorted = malloc(n * sizeof *sorted);
+    res = malloc(n * sizeof *res);
+    if (!items || !sorted || !res)
+    {
+        free(items);
+        free(sorted);
+        free(res);
+
+        for (i = found = 0; i < n; i++)
+        {
+            if ((out[i] = bst_get(t, keys[i])) || bst_contains(t, keys[i]))
+                found++;
+        }
+        return found;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        items[i].key = keys[i];
+        items[i].i = i;
+    }
+    qsort(items, n, sizeof *items, bstitem_cmp);
+
+    for (i = 0; i < n; i++)
+        sorted[i] = items[i].key;
+
+    found = bst_get_sorted(t, t->root, sorted, res, n);
+
+    for (i = 0; i < n; i++)
+        out[items[i].i] = res[i];
+
+    free(items);
+    free(sorted);
+    free(res);
+    return found;
+}
+
+int bst_get_all(bst *t, long key, bstiter *it)
+{
+    bstnode *last;
+
+    if (t->origin)
+    {
+        bst_lower_bound(t, key, it);
+        it->n_left = bst_rank_upper(t, key) - it->pos;
+        return (it->n_left) ? 0 : -1;
+    }
+
+    if (bst_lower_bound(t, key, it) || it->next->key != key)
+    {
+        it->next = NULL;
+        return -1;
+    }
+
+    /* stop behind the last item with equal key */
+    last = bst_upper(t, key);
+    it->end = bstnode_next(last);
+    return 0;
+}
+
+size_t bst_count(bst *t, long key)
+{
+    return bst_rank_upper(t, key) - bst_rank(t, key);
+}
+
+#define EXTREME(name, dir)                          \
+int bst_##name(bst *t, long *key, void **data)      \
+{                                                   \
+    bstnode *n;                                     \
+                                                    \
+    if (!t || !t->root)                             \
+        return -1;                                  \
+                                                    \
+    for (n = t->root; !IS_LEAF(n->dir); )           \
+        n = n->dir;                                 \
+                                                    \
+    if (key) *key = n->key;                         \
+    if (data) *data = n->data;                      \
+    return 0;                                       \
+}
+
+EXTREME(min, left)
+EXTREME(max, right)
+
+int bst_floor(bst *t, long key, long *found, void **data)
+{
+    bstnode *n;
+
+    if (!t || !(n = bst_upper(t, key)))
+        return -1;
+
+    if (found) *found = n->key;
+    if (data) *data = n->data;
+    return 0;
+}
+
+int bst_ceil(bst *t, long key, long *found, void **data)
+{
+    bstnode *n;
+
+    if (!t || !(n = bst_lower(t, key)))
+        return -1;
+
+    if (found) *found = n->key;
+    if (data) *data = n->data;
+    return 0;
+}
+
+void bst_iter(bst *t, bstiter *it, int reverse)
+{
+    /* parent pointers of snapshots can't be used, go by rank instead */
+    bstnode *n = (t->origin) ? NULL : t->root;
+
+    if (n)
+    {
+        if (reverse)
+            while (!IS_LEAF(n->right))
+                n = n->right;
+        else
+            while (!IS_LEAF(n->left))
+                n = n->left;
+    }
+
+    it->t = t;
+    it->next = n;
+    it->end = NULL;
+    it->reverse = reverse;
+    it->n_left = (t->origin) ? bst_size(t) : 0;
+    it->pos = (reverse) ? it->n_left - 1 : 0;
+}
+
+int bst_lower_bound(bst *t, long key, bstiter *it)
+{
+    it->t = t;
+    it->end = NULL;
+    it->reverse = 0;
+
+    if (t->origin)
+    {
+        it->next = NULL;
+        it->pos = bst_rank(t, key);
+        it->n_left = bst_size(t) - it->pos;
+        return (it->n_left) ? 0 : -1;
+    }
+
+    it->next = bst_lower(t, key);
+    it->pos = 0;
+    it->n_left = 0;
+    return (it->next) ? 0 : -1;
+}
+
+int bstiter_next(bstiter *it, long *key, void **data)
+{
+    bstnode *n = it->next;
+
+    if (it->t->origin)
+    {
+        if (!it->n_left)
+            return 0;
+
+        bst_select(it->t, it->pos, key, data);
+        if (it->reverse)
+            it->pos--;
+        else
+            it->pos++;
+        it->n_left--;
+        return 1;
+    }
+
+    if (!n || n == it->end)
+        return 0;
+
+    if (key) *key = n->key;
+    if (data) *data = n->data;
+
+    it->next = (it->reverse) ? bstnode_prev(n) : bstnode_next(n);
+    return 1;
+}
+
+size_t bst_range(bst *t, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    bstnode *stack[BST_MAX_HEIGHT], *n;
+    size_t count = 0;
+    int top = 0;
+
+    if (!t || !t->root || lo > hi)
+        return 0;
+
+    /* just counting doesn't need to visit the items */
+    if (!callback)
+        return bst_rank_upper(t, hi) - bst_rank(t, lo);
+
+    /* no parent pointers, so that this works on snapshots: the stack holds
+     * the ancestors >= lo of the next node */
+    for (n = t->root; !IS_LEAF(n); )
+    {
+        if (n->key >= lo)
+        {
+            stack[top++] = n;
+            n = n->left;
+        }
+        else
+            n = n->right;
+    }
+
+    while (top)
+    {
+        n = stack[--top];
+        if (n->key > hi)
+            break;
+
+        if (callback)
+            callback(n->key, n->data, arg);
+        count++;
+
+        for (n = n->right; !IS_LEAF(n); n = n->left)
+            stack[top++] = n;
+    }
+    return count;
+}
+
+size_t bst_range_above(bst *t, long lo, long hi, long min,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    bstnode *stack[BST_MAX_HEIGHT], *n;
+    size_t count = 0;
+    int top = 0, prune;
+
+    if (!t || !t->root || lo > hi)
+        return 0;
+
+    /* skip subtrees whose maximum is <= min */
+    prune = (t->combine == bstmonoid_max.combine);
+
+    for (n = t->root; ; n = n->right)
+    {
+        /* like bst_range(): push the ancestors >= lo of the next node */
+        while (!IS_LEAF(n) && !(prune && NODE_AGG(n) <= min))
+        {
+            if (n->key >= lo)
+            {
+                stack[top++] = n;
+                n = n->left;
+            }
+            else
+                n = n->right;
+        }
+
+        if (!top)
+            break;
+
+        n = stack[--top];
+        if (n->key > hi)
+            break;
+
+        if (!t->value || t->value(n->key, n->data) > min)
+        {
+            if (callback)
+                callback(n->key, n->data, arg);
+            count++;
+        }
+    }
+    return count;
+}
+
+int bst_augment(bst *t, const bstmonoid *m, long (*value)(long, void*))
+{
+    if (t->origin || bst_prepare(t) || t->snapshots)
+        return -1;
+
+    /* unaugmented trees use nodes without room for the aggregate */
+    if (m && t->arena->node_size != sizeof(struct bstaugnode) && bst_widen(t))
+        return -1;
+
+    t->identity = (m) ? m->identity : 0;
+    t->combine = (m) ? m->combine : NULL;
+    t->value = value;
+
+    if (t->combine && t->root)
+        bstnode_update_all(t, t->root);
+    return 0;
+}
+
+long bst_aggregate(bst *t, long lo, long hi)
+{
+    bstnode *n, *s;
+    long res;
+
+    if (!t || !t->combine || !t->root)
+        return (t) ? t->identity : 0;
+
+    /* topmost node in [lo, hi]; the paths to lo and hi split there */
+    for (s = t->root; !IS_LEAF(s) && (s->key < lo || s->key > hi); )
+        s = (s->key < lo) ? s->right : s->left;
+
+    if (IS_LEAF(s))
+        return t->identity;
+
+    res = t->value(s->key, s->data);
+
+    /* nodes >= lo on the path to lo cover themselves and their right
+     * subtree; they're visited in descending order */
+    for (n = s->left; !IS_LEAF(n); )
+    {
+        if (n->key >= lo)
+        {
+            res = t->combine(t->combine(t->value(n->key, n->data),
+                        AGG(t, n->right)), res);
+            n = n->left;
+        }
+        else
+            n = n->right;
+    }
+
+    /* the same for hi, in ascending order */
+    for (n = s->right; !IS_LEAF(n); )
+    {
+        if (n->key <= hi)
+        {
+            res = t->combine(res, t->combine(AGG(t, n->left),
+                        t->value(n->key, n->data)));
+            n = n->right;
+        }
+        else
+            n = n->left;
+    }
+    return res;
+}
+
+size_t bst_rank(bst *t, long key)
+{
+    bstnode *n;
+    size_t rank = 0;
+
+    if (!t || !t->root)
+        return 0;
+
+    for (n = t->root; !IS_LEAF(n); )
+    {
+        if (key <= n->key)
+            n = n->left;
+        else
+        {
+            rank += n->left->size + 1;
+            n = n->right;
+        }
+    }
+    return rank;
+}
+
+int bst_select(bst *t, size_t i, long *key, void **data)
+{
+    bstnode *n;
+
+    if (!t || i >= bst_size(t))
+        return -1;
+
+    n = t->root;
+    while (i != n->left->size)
+    {
+        if (i < n->left->size)
+            n = n->left;
+        else
+        {
+            i -= n->left->size + 1;
+            n = n->right;
+        }
+    }
+
+    if (key) *key = n->key;
+    if (data) *data = n->data;
+    return 0;
+}
@@ -25,16 +25,53 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef BST_H
 #define BST_H
 
+#include <stddef.h>
+
 /***********/
 /* DEFINES */
 /***********/
 
+/* option to bst_init_o(): allow multiple items with equal key. They are
+ * kept in insertion order; bst_get(), bst_remove() etc. operate on the
+ * first one, use bst_get_all(), bst_count() and bst_remove_data() to
+ * access all of them */
+#define BST_MULTI 0x01
+
 /*==========*/
 /* typedefs */
 /*==========*/
 
 typedef struct bst bst;
 
+/* aggregate function for bst_augment(): combine must be associative (but
+ * needn't be commutative), and identity must be its neutral element */
+typedef struct bstmonoid
+{
+    long identity;
+    long (*combine)(long, long);
+} bstmonoid;
+
+/* in-order iterator, see bst_iter(); it can live on the stack and
+ * doesn't have to be free'd. Modifying the tree invalidates it */
+typedef struct bstiter
+{
+    bst *t;
+    struct bstnode *next;
+    /* first node not to return, or NULL */
+    struct bstnode *end;
+    int reverse;
+    /* snapshots only (their nodes have no usable parent pointers): rank
+     * of the next item and number of items left */
+    size_t pos;
+    size_t n_left;
+} bstiter;
+
+
+/* sum, minimum and maximum */
+extern const bstmonoid bstmonoid_sum;
+extern const bstmonoid bstmonoid_min;
+extern const bstmonoid bstmonoid_max;
+
 
 /*************/
 /* FUNCTIONS */
@@ -47,12 +84,53 @@ typedef struct bst bst;
 /* initialize bst */
 bst *bst_init(void);
 
+/* initialize bst with options (i.e. BST_MULTI) */
+bst *bst_init_o(int options);
+
+/* create a bst from n items in O(n); keys must be strictly ascending (else
+ * NULL is returned), data may be NULL */
+bst *bst_build_sorted(const long *keys, void **data, size_t n);
+
+/* like bst_build_sorted(), with options; with BST_MULTI, keys only need
+ * to be ascending */
+bst *bst_build_sorted_o(const long *keys, void **data, size_t n, int options);
+
 /* remove all nodes from tree; leaves an empty tree */
 void bst_clear(bst *t, void (*callback)(void*));
 
-/* free a bst */
+/* free a bst or release a snapshot (the callback isn't used then) */
 void bst_free(bst *t, void (*callback)(void*));
 
+/* return a read-only snapshot of the tree in O(1), or NULL on error.
+ * Afterwards, updates of t copy the nodes they change instead of
+ * modifying them, so the snapshot stays unchanged. It can be read from
+ * other threads while t is updated. Iterators work on snapshots, but each
+ * step takes O(log n) there; bst_range() is faster.
+ * Only the thread updating t may take snapshots, but any thread may
+ * release them with bst_free() (built without GNU C atomics, only the
+ * thread updating t may); the nodes are reclaimed by the next
+ * update of t. Snapshots share the data pointers with t, so the callbacks
+ * of bst_remove(), bst_remove_data() and bst_clear() must not free data
+ * while snapshots exist. All snapshots must be released before t is
+ * freed */
+bst *bst_snapshot(bst *t);
+
+/* split t in O(log n): afterwards, t holds the items with a key < key and
+ * is stored in *left, the others are moved to a new tree stored in
+ * *right. Both trees share their node storage, so they must not be
+ * updated concurrently. Returns -1 if t has snapshots or on error */
+int bst_split(bst *t, long key, bst **left, bst **right);
+
+/* move all items of right to left and free right in O(log n); all keys of
+ * left must be smaller than (with BST_MULTI: not greater than) those of
+ * right, and either both or neither of the trees must use BST_MULTI.
+ * Returns -1 (leaving both trees unchanged) if they don't or if one of
+ * the trees has snapshots */
+int bst_join(bst *left, bst *right);
+
+/* number of items in the tree */
+size_t bst_size(bst *t);
+
 
 /*=================*/
 /* data operations */
@@ -62,17 +140,28 @@ void bst_free(bst *t, void (*callback)(void*));
 /* insert */
 /*--------*/
 
-/* insert an item into the tree */
+/* insert an item into the tree; returns -1 if there's an item with equal
+ * key already (unless BST_MULTI is set) */
 int bst_insert(bst *t, long key, void *data);
 
+/* insert n items (data may be NULL); unless BST_MULTI is set, keys already
+ * in the tree are skipped, as are repeated keys in the batch (only one of
+ * them is inserted). Large batches are sorted and merged with the tree,
+ * which is then rebuilt. Returns -1 if allocation failed */
+int bst_insert_many(bst *t, const long *keys, void **data, size_t n);
+
 
 /*--------*/
 /* delete */
 /*--------*/
 
-/* delete item with equal key from tree */
+/* delete (first) item with equal key from tree; see bst_snapshot() for
+ * the callback on trees with snapshots */
 int bst_remove(bst *t, long key, void (*callback)(void*));
 
+/* delete the first item with equal key and data from tree */
+int bst_remove_data(bst *t, long key, void *data, void (*callback)(void*));
+
 
 /*----------*/
 /* retrieve */
@@ -84,4 +173,83 @@ int bst_contains(bst *t, long key);
 /* get (first) item with equal key */
 void *bst_get(bst *t, long key);
 
+/* like bst_get() for n keys, storing the results in out[0..n) (NULL if a
+ * key isn't found); returns the number of keys found. Ascending keys are
+ * resolved in one descent that visits every node at most once, so nearby
+ * keys share the walk through the upper levels; other batches are sorted
+ * first */
+size_t bst_get_many(bst *t, const long *keys, size_t n, void **out);
+
+/* initialize iterator at the first item with equal key, returning all
+ * items with that key; returns -1 if there is none */
+int bst_get_all(bst *t, long key, bstiter *it);
+
+/* return the number of items with equal key */
+size_t bst_count(bst *t, long key);
+
+/* store key and data of the item with the smallest/greatest key in the
+ * passed pointers (may be NULL); returns -1 if the tree is empty */
+int bst_min(bst *t, long *key, void **data);
+int bst_max(bst *t, long *key, void **data);
+
+/* store item with the greatest key <= key (floor) or the smallest key
+ * >= key (ceil) in the passed pointers; returns -1 if there is none */
+int bst_floor(bst *t, long key, long *found, void **data);
+int bst_ceil(bst *t, long key, long *found, void **data);
+
+/* return the number of items with a key < key */
+size_t bst_rank(bst *t, long key);
+
+/* store the item with rank i (i.e. the i-th smallest key, starting at 0)
+ * in the passed pointers; returns -1 if i >= bst_size(t) */
+int bst_select(bst *t, size_t i, long *key, void **data);
+
+
+/*===========*/
+/* iteration */
+/*===========*/
+
+/* initialize iterator at the smallest (or, if reverse is non-zero, at the
+ * greatest) key */
+void bst_iter(bst *t, bstiter *it, int reverse);
+
+/* initialize iterator at the first item with key >= key, iterating in
+ * ascending order; returns -1 if there is no such item */
+int bst_lower_bound(bst *t, long key, bstiter *it);
+
+/* store next key and data in the passed pointers (may be NULL);
+ * returns zero if there are no more items */
+int bstiter_next(bstiter *it, long *key, void **data);
+
+/* call callback(key, data, arg) on all items with lo <= key <= hi in
+ * ascending order; returns the number of items (in O(log n) if callback
+ * is NULL) */
+size_t bst_range(bst *t, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg);
+
+
+/*=============*/
+/* aggregation */
+/*=============*/
+
+/* keep the aggregate (see bst_aggregate()) of the values
+ * value(key, data) of all items in each subtree, updating it on every
+ * change of the tree; with m == NULL, stop doing so. Takes O(n), returns
+ * -1 if t has snapshots or on error. Nodes of unaugmented trees have no
+ * room for the aggregate, so the first call copies the items to larger
+ * nodes. Trees can only be joined if they use the same functions */
+int bst_augment(bst *t, const bstmonoid *m, long (*value)(long, void*));
+
+/* like bst_range(), but only for items with value(key, data) > min (see
+ * bst_augment()). If t is augmented with bstmonoid_max, subtrees without
+ * such items are skipped, so this takes O(log n + k log(n/k)) for k
+ * items */
+size_t bst_range_above(bst *t, long lo, long hi, long min,
+        void (*callback)(long, void*, void*), void *arg);
+
+/* combine the values of all items with lo <= key <= hi in ascending order
+ * in O(log n); returns the identity if there are none (or 0 if t isn't
+ * augmented) */
+long bst_aggregate(bst *t, long lo, long hi);
+
 #endif
@@ -0,0 +1,444 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* mmap() etc. */
+#define _POSIX_C_SOURCE 200112L
+
+#include "bstfrozen.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* the keys array is aligned to cache lines, so the 2^k descendants of a
+ * node k levels below it share a line if 2^k keys fit into one */
+#define BSF_LINE 64
+#define BSF_PREFETCH_STEP (BSF_LINE / sizeof(long))
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+/* round up to a multiple of BSF_LINE */
+#define BSF_ALIGN(x) (((x) + BSF_LINE - 1) / BSF_LINE * BSF_LINE)
+
+/* data of node i: a pointer of a frozen tree or a record of a mapped one */
+#define BSF_DATA(f, i) ((f)->data ? (f)->data[i] : \
+        (f)->size ? (void*)((f)->recs + ((i) - 1) * (f)->size) : NULL)
+
+/* files written by bst_save() start with this and a struct bsfheader;
+ * the order field catches files from machines with another byte order or
+ * size of long */
+#define BSF_MAGIC "bstfrzn"
+#define BSF_ORDER (0x0100UL | sizeof(long))
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+/* node i has children 2i and 2i+1, the root is at 1 */
+struct bstfrozen
+{
+    size_t n;
+    long *keys;
+    /* NULL if mapped by bst_open_mmap() */
+    void **data;
+    /* allocated block keys points into */
+    void *mem;
+    /* mapped file: records of size bytes in node order */
+    char *recs;
+    size_t size;
+    void *map;
+    size_t maplen;
+};
+
+/* start of a file written by bst_save(), padded to BSF_LINE bytes; the
+ * keys follow (including the unused keys[0]), then the records starting
+ * at the next multiple of BSF_LINE */
+struct bsfheader
+{
+    char magic[8];
+    unsigned long order;
+    unsigned long n;
+    unsigned long size;
+};
+
+/* position in a frozen tree while filling it in order */
+struct bsffill
+{
+    bstfrozen *f;
+    size_t i;
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* go up from i past all ancestors i is in the right subtree of and one
+ * more level; that's i's in-order successor if i has no right child (0
+ * if there is none) */
+static size_t bsf_up(size_t i);
+
+/* first node in order, or 0 if f is empty */
+static size_t bsf_first(bstfrozen *f);
+
+/* in-order successor of node i, or 0 */
+static size_t bsf_next(bstfrozen *f, size_t i);
+
+/* first node with key >= key, or 0 */
+static size_t bsf_lower(bstfrozen *f, long key);
+
+/* bst_range() callback storing an item at the next position */
+static void bsf_fill(long key, void *data, void *arg);
+
+/* return 0 if h is a valid header of a file of len bytes */
+static int bsf_check(const struct bsfheader *h, size_t len);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static size_t bsf_up(size_t i)
+{
+    /* strip the trailing right steps and one left step */
+#ifdef __GNUC__
+    return i >> (__builtin_ctzl(~(unsigned long)i) + 1);
+#else
+    while (i & 1)
+        i >>= 1;
+    return i >> 1;
+#endif
+}
+
+static size_t bsf_first(bstfrozen *f)
+{
+    size_t i = 1;
+
+    if (!f->n)
+        return 0;
+
+    while (2 * i <= f->n)
+        i *= 2;
+    return i;
+}
+
+static size_t bsf_next(bstfrozen *f, size_t i)
+{
+    if (2 * i + 1 > f->n)
+        return bsf_up(i);
+
+    for (i = 2 * i + 1; 2 * i <= f->n; i *= 2)
+        ;
+    return i;
+}
+
+static size_t bsf_lower(bstfrozen *f, long key)
+{
+    const long *keys = f->keys;
+    size_t i = 1, n = f->n;
+
+    /* the comparison only decides which child to take, so the loop runs
+     * for the full height of the tree and never mispredicts */
+    while (i <= n)
+    {
+        PREFETCH(keys + BSF_PREFETCH_STEP * i);
+        i = 2 * i + (keys[i] < key);
+    }
+
+    /* the last node where the path went left */
+    return bsf_up(i);
+}
+
+static void bsf_fill(long key, void *data, void *arg)
+{
+    struct bsffill *fill = arg;
+
+    fill->f->keys[fill->i] = key;
+    fill->f->data[fill->i] = data;
+    fill->i = bsf_next(fill->f, fill->i);
+}
+
+static int bsf_check(const struct bsfheader *h, size_t len)
+{
+    size_t keys;
+
+    if (memcmp(h->magic, BSF_MAGIC, sizeof h->magic) ||
+            h->order != BSF_ORDER)
+        return -1;
+
+    /* the sizes must add up without overflowing */
+    len -= BSF_LINE;
+    if (h->n >= len / sizeof(long))
+        return -1;
+
+    keys = BSF_ALIGN((h->n + 1) * sizeof(long));
+    if (keys > len || (h->size && (len - keys) / h->size < h->n))
+        return -1;
+
+    return (len - keys == h->n * h->size) ? 0 : -1;
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+/*============*/
+/* management */
+/*============*/
+
+bstfrozen *bst_freeze(bst *t)
+{
+    bstfrozen *f;
+    struct bsffill fill;
+    size_t n = bst_size(t);
+
+    if (!(f = malloc(sizeof *f)))
+        return NULL;
+
+    f->n = n;
+    f->recs = NULL;
+    f->size = 0;
+    f->map = NULL;
+    f->maplen = 0;
+    f->mem = malloc((n + 1) * sizeof *f->keys + BSF_LINE);
+    f->data = malloc((n + 1) * sizeof *f->data);
+    if (!f->mem || !f->data)
+    {
+        free(f->mem);
+        free(f->data);
+        free(f);
+        return NULL;
+    }
+    f->keys = (long*)((char*)f->mem +
+            (BSF_LINE - (unsigned long)f->mem % BSF_LINE) % BSF_LINE);
+    f->keys[0] = 0;
+
+    fill.f = f;
+    fill.i = bsf_first(f);
+    bst_range(t, LONG_MIN, LONG_MAX, bsf_fill, &fill);
+
+    return f;
+}
+
+bst *bst_thaw(bstfrozen *f)
+{
+    bst *t;
+    long *keys;
+    void **data;
+    size_t i, j;
+    int options = 0;
+
+    if (!f->n)
+        return bst_init();
+
+    keys = malloc(f->n * sizeof *keys);
+    data = malloc(f->n * sizeof *data);
+    if (!keys || !data)
+    {
+        free(keys);
+        free(data);
+        return NULL;
+    }
+
+    for (i = bsf_first(f), j = 0; i; i = bsf_next(f, i), j++)
+    {
+        keys[j] = f->keys[i];
+        data[j] = BSF_DATA(f, i);
+
+        /* frozen from a BST_MULTI tree */
+        if (j && keys[j - 1] == keys[j])
+            options = BST_MULTI;
+    }
+
+    t = bst_build_sorted_o(keys, data, f->n, options);
+    free(keys);
+    free(data);
+    return t;
+}
+
+int bst_save(bst *t, const char *path, size_t size,
+        void (*encode)(long, void*, void*))
+{
+    bstfrozen *f;
+    struct bsfheader h;
+    char pad[BSF_LINE], *rec = NULL;
+    FILE *fp = NULL;
+    size_t i, len;
+    int res = -1;
+
+    if (!(f = bst_freeze(t)))
+        return -1;
+
+    if ((size && !(rec = malloc(size))) || !(fp = fopen(path, "wb")))
+        goto out;
+
+    memset(pad, 0, sizeof pad);
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, BSF_MAGIC, sizeof h.magic);
+    h.order = BSF_ORDER;
+    h.n = f->n;
+    h.size = size;
+
+    len = (f->n + 1) * sizeof *f->keys;
+    if (fwrite(&h, sizeof h, 1, fp) != 1 ||
+            fwrite(pad, BSF_LINE - sizeof h, 1, fp) != 1 ||
+            fwrite(f->keys, len, 1, fp) != 1 ||
+            (BSF_ALIGN(len) > len &&
+             fwrite(pad, BSF_ALIGN(len) - len, 1, fp) != 1))
+        goto out;
+
+    /* records in node order, so node i's is found without a data array */
+    for (i = 1; size && i <= f->n; i++)
+    {
+        if (encode)
+            encode(f->keys[i], f->data[i], rec);
+        else if (f->data[i])
+            memcpy(rec, f->data[i], size);
+        else
+            memset(rec, 0, size);
+
+        if (fwrite(rec, size, 1, fp) != 1)
+            goto out;
+    }
+    res = 0;
+
+out:
+    if (fp && fclose(fp))
+        res = -1;
+    free(rec);
+    bsf_free(f);
+    return res;
+}
+
+bstfrozen *bst_open_mmap(const char *path)
+{
+    bstfrozen *f;
+    struct bsfheader h;
+    struct stat st;
+    void *map;
+    size_t len;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return NULL;
+
+    if (fstat(fd, &st) || (size_t)st.st_size < BSF_LINE)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    /* the mapping stays valid after closing the file */
+    len = st.st_size;
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    memcpy(&h, map, sizeof h);
+    if (bsf_check(&h, len) || !(f = malloc(sizeof *f)))
+    {
+        munmap(map, len);
+        return NULL;
+    }
+
+    f->n = h.n;
+    f->keys = (long*)((char*)map + BSF_LINE);
+    f->data = NULL;
+    f->mem = NULL;
+    f->recs = (char*)f->keys + BSF_ALIGN((h.n + 1) * sizeof(long));
+    f->size = h.size;
+    f->map = map;
+    f->maplen = len;
+    return f;
+}
+
+void bsf_free(bstfrozen *f)
+{
+    if (!f)
+        return;
+
+    if (f->map)
+        munmap(f->map, f->maplen);
+    free(f->mem);
+    free(f->data);
+    free(f);
+}
+
+size_t bsf_size(bstfrozen *f)
+{
+    return f->n;
+}
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+int bsf_contains(bstfrozen *f, long key)
+{
+    size_t i = bsf_lower(f, key);
+    return (i && f->keys[i] == key);
+}
+
+void *bsf_get(bstfrozen *f, long key)
+{
+    size_t i = bsf_lower(f, key);
+    return (i && f->keys[i] == key) ? BSF_DATA(f, i) : NULL;
+}
+
+size_t bsf_range(bstfrozen *f, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    size_t i, count = 0;
+
+    for (i = bsf_lower(f, lo); i && f->keys[i] <= hi; i = bsf_next(f, i))
+    {
+        if (callback)
+            callback(f->keys[i], BSF_DATA(f, i), arg);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BSTFROZEN_H
+#define BSTFROZEN_H
+
+/* read-only copy of a bst, stored in one array in Eytzinger (breadth-first)
+ * order; lookups walk down the array without branching on the keys and
+ * prefetch the nodes a few levels below */
+
+#include "bst.h"
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct bstfrozen bstfrozen;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* create a frozen copy of t (which may be a snapshot) in O(n), or NULL on
+ * error; t is left unchanged */
+bstfrozen *bst_freeze(bst *t);
+
+/* create a bst with the items of f, or NULL on error */
+bst *bst_thaw(bstfrozen *f);
+
+/* write t (which may be a snapshot) to a file that bst_open_mmap() can
+ * map, in the layout of a frozen tree; size bytes are stored per item,
+ * copied from data or written to rec by encode(key, data, rec) if not
+ * NULL. returns -1 on error */
+int bst_save(bst *t, const char *path, size_t size,
+        void (*encode)(long, void*, void*));
+
+/* map a file written by bst_save() read-only, or NULL on error; lookups
+ * read the file directly, the data of an item is a pointer to its record
+ * (NULL if size was 0). bst_thaw() loads it into a bst in O(n), whose data
+ * also point into the mapping */
+bstfrozen *bst_open_mmap(const char *path);
+
+/* free a frozen tree (the data pointers aren't touched) or unmap a file */
+void bsf_free(bstfrozen *f);
+
+/* number of items */
+size_t bsf_size(bstfrozen *f);
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* return non-zero if there's an item with equal key */
+int bsf_contains(bstfrozen *f, long key);
+
+/* get item with equal key */
+void *bsf_get(bstfrozen *f, long key);
+
+/* call callback(key, data, arg) on all items with lo <= key <= hi in
+ * ascending order; returns the number of items */
+size_t bsf_range(bstfrozen *f, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg);
+
+#endif
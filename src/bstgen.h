@@ -0,0 +1,573 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* type-specialized red-black tree; including this file generates the type
+ * and functions of one tree from the following macros (which are
+ * undefined afterwards):
+ *
+ *  BSTG_NAME           prefix of the type and functions, e.g. tsmap gives
+ *                      tsmap, tsmap_init(), tsmap_insert(), ...
+ *  BSTG_KEY            key type; keys are passed and stored by value
+ *  BSTG_CMP(t, a, b)   compare keys a and b of tree t, returning < 0, 0 or
+ *                      > 0. It's expanded inline, so a simple expression
+ *                      doesn't cost a function call
+ *
+ * and optionally:
+ *
+ *  BSTG_IMPLEMENT      also emit the function definitions, not just the
+ *                      declarations
+ *  BSTG_SCOPE          storage class of the functions, e.g. static
+ *  BSTG_FIELDS         additional members of the tree struct
+ *  BSTG_INIT_PARAMS    parameter list of BSTG_NAME_init(), default void
+ *  BSTG_INIT(t)        statement initializing BSTG_FIELDS from them
+ *
+ * The functions work like the bst_ functions of the same name; callbacks
+ * get the stored key along with the data. A tree is usually declared in a
+ * header and implemented in one source file defining BSTG_IMPLEMENT before
+ * including that header, see gbst.h. For a tree private to a source file,
+ * define BSTG_SCOPE as static and BSTG_IMPLEMENT right away. */
+
+#ifndef BSTGEN_H
+#define BSTGEN_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+/*========*/
+/* macros */
+/*========*/
+
+#define BSTG_CAT2(a, b) a##b
+#define BSTG_CAT(a, b) BSTG_CAT2(a, b)
+
+/* name of a generated function */
+#define BSTG_FN(f) BSTG_CAT(BSTG_NAME, BSTG_CAT(_, f))
+
+/* node type of the generated tree */
+#define BSTG_NODE struct BSTG_CAT(BSTG_NAME, node)
+
+/* leaves are NULL and black */
+#define BSTG_RED(n) ((n) && (n)->red)
+
+#ifdef __GNUC__
+#define BSTG_UNUSED __attribute__((unused))
+#else
+#define BSTG_UNUSED
+#endif
+
+#endif
+
+
+#ifndef BSTG_SCOPE
+#define BSTG_SCOPE
+#endif
+
+#ifndef BSTG_FIELDS
+#define BSTG_FIELDS
+#endif
+
+#ifndef BSTG_INIT_PARAMS
+#define BSTG_INIT_PARAMS void
+#endif
+
+#ifndef BSTG_INIT
+#define BSTG_INIT(t)
+#endif
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+typedef struct BSTG_NAME BSTG_NAME;
+
+BSTG_NODE
+{
+    BSTG_KEY key;
+    void *data;
+    BSTG_NODE *parent;
+    BSTG_NODE *left;
+    BSTG_NODE *right;
+    int red;
+};
+
+struct BSTG_NAME
+{
+    BSTG_NODE *root;
+    size_t size;
+    BSTG_FIELDS
+};
+
+
+/*==============*/
+/* declarations */
+/*==============*/
+
+BSTG_SCOPE BSTG_UNUSED BSTG_NAME *BSTG_FN(init)(BSTG_INIT_PARAMS);
+BSTG_SCOPE BSTG_UNUSED void BSTG_FN(clear)(BSTG_NAME *t,
+        void (*callback)(BSTG_KEY, void*));
+BSTG_SCOPE BSTG_UNUSED void BSTG_FN(free)(BSTG_NAME *t,
+        void (*callback)(BSTG_KEY, void*));
+BSTG_SCOPE BSTG_UNUSED size_t BSTG_FN(size)(BSTG_NAME *t);
+
+BSTG_SCOPE BSTG_UNUSED int BSTG_FN(insert)(BSTG_NAME *t, BSTG_KEY key,
+        void *data);
+BSTG_SCOPE BSTG_UNUSED int BSTG_FN(remove)(BSTG_NAME *t, BSTG_KEY key,
+        void (*callback)(BSTG_KEY, void*));
+
+BSTG_SCOPE BSTG_UNUSED int BSTG_FN(contains)(BSTG_NAME *t, BSTG_KEY key);
+BSTG_SCOPE BSTG_UNUSED void *BSTG_FN(get)(BSTG_NAME *t, BSTG_KEY key);
+BSTG_SCOPE BSTG_UNUSED int BSTG_FN(min)(BSTG_NAME *t, BSTG_KEY *key,
+        void **data);
+BSTG_SCOPE BSTG_UNUSED int BSTG_FN(max)(BSTG_NAME *t, BSTG_KEY *key,
+        void **data);
+BSTG_SCOPE BSTG_UNUSED size_t BSTG_FN(range)(BSTG_NAME *t,
+        BSTG_KEY lo, BSTG_KEY hi,
+        void (*callback)(BSTG_KEY, void*, void*), void *arg);
+
+
+#ifdef BSTG_IMPLEMENT
+
+/*==================*/
+/* static functions */
+/*==================*/
+
+static BSTG_UNUSED void BSTG_FN(rotate_left)(BSTG_NAME *t, BSTG_NODE *n)
+{
+    BSTG_NODE *r = n->right;
+
+    n->right = r->left;
+    if (r->left)
+        r->left->parent = n;
+
+    r->parent = n->parent;
+    if (!n->parent)
+        t->root = r;
+    else if (n == n->parent->left)
+        n->parent->left = r;
+    else
+        n->parent->right = r;
+
+    r->left = n;
+    n->parent = r;
+}
+
+static BSTG_UNUSED void BSTG_FN(rotate_right)(BSTG_NAME *t, BSTG_NODE *n)
+{
+    BSTG_NODE *l = n->left;
+
+    n->left = l->right;
+    if (l->right)
+        l->right->parent = n;
+
+    l->parent = n->parent;
+    if (!n->parent)
+        t->root = l;
+    else if (n == n->parent->right)
+        n->parent->right = l;
+    else
+        n->parent->left = l;
+
+    l->right = n;
+    n->parent = l;
+}
+
+static BSTG_UNUSED BSTG_NODE *BSTG_FN(find)(BSTG_NAME *t, BSTG_KEY key)
+{
+    BSTG_NODE *n = t->root;
+    int c;
+
+    while (n)
+    {
+        c = BSTG_CMP(t, key, n->key);
+        if (c < 0)
+            n = n->left;
+        else if (c > 0)
+            n = n->right;
+        else
+            break;
+    }
+    return n;
+}
+
+static BSTG_UNUSED BSTG_NODE *BSTG_FN(next)(BSTG_NODE *n)
+{
+    if (n->right)
+    {
+        for (n = n->right; n->left; n = n->left)
+            ;
+        return n;
+    }
+
+    while (n->parent && n == n->parent->right)
+        n = n->parent;
+    return n->parent;
+}
+
+static BSTG_UNUSED void BSTG_FN(insert_repair)(BSTG_NAME *t, BSTG_NODE *n)
+{
+    BSTG_NODE *p, *g, *u;
+
+    /* n is red; while its parent is red too, there's a black grandparent */
+    while ((p = n->parent) && p->red)
+    {
+        g = p->parent;
+        u = (p == g->left) ? g->right : g->left;
+
+        /* red uncle: push the red up */
+        if (BSTG_RED(u))
+        {
+            p->red = u->red = 0;
+            g->red = 1;
+            n = g;
+            continue;
+        }
+
+        /* black uncle: rotate n's parent into the grandparent's place */
+        if (p == g->left)
+        {
+            if (n == p->right)
+            {
+                BSTG_FN(rotate_left)(t, p);
+                p = n;
+            }
+            BSTG_FN(rotate_right)(t, g);
+        }
+        else
+        {
+            if (n == p->left)
+            {
+                BSTG_FN(rotate_right)(t, p);
+                p = n;
+            }
+            BSTG_FN(rotate_left)(t, g);
+        }
+        p->red = 0;
+        g->red = 1;
+        break;
+    }
+    t->root->red = 0;
+}
+
+/* n (which may be NULL) below p lacks one black node */
+static BSTG_UNUSED void BSTG_FN(remove_repair)(BSTG_NAME *t, BSTG_NODE *n,
+        BSTG_NODE *p)
+{
+    BSTG_NODE *s;
+
+    while (p && !BSTG_RED(n))
+    {
+        if (n == p->left)
+        {
+            s = p->right;
+            if (s->red)
+            {
+                s->red = 0;
+                p->red = 1;
+                BSTG_FN(rotate_left)(t, p);
+                s = p->right;
+            }
+
+            if (!BSTG_RED(s->left) && !BSTG_RED(s->right))
+            {
+                s->red = 1;
+                n = p;
+                p = n->parent;
+                continue;
+            }
+
+            if (!BSTG_RED(s->right))
+            {
+                s->left->red = 0;
+                s->red = 1;
+                BSTG_FN(rotate_right)(t, s);
+                s = p->right;
+            }
+            s->red = p->red;
+            p->red = 0;
+            s->right->red = 0;
+            BSTG_FN(rotate_left)(t, p);
+        }
+        else
+        {
+            s = p->left;
+            if (s->red)
+            {
+                s->red = 0;
+                p->red = 1;
+                BSTG_FN(rotate_right)(t, p);
+                s = p->left;
+            }
+
+            if (!BSTG_RED(s->left) && !BSTG_RED(s->right))
+            {
+                s->red = 1;
+                n = p;
+                p = n->parent;
+                continue;
+            }
+
+            if (!BSTG_RED(s->left))
+            {
+                s->right->red = 0;
+                s->red = 1;
+                BSTG_FN(rotate_left)(t, s);
+                s = p->left;
+            }
+            s->red = p->red;
+            p->red = 0;
+            s->left->red = 0;
+            BSTG_FN(rotate_right)(t, p);
+        }
+        n = t->root;
+        break;
+    }
+
+    if (n)
+        n->red = 0;
+}
+
+
+/*====================*/
+/* exported functions */
+/*====================*/
+
+BSTG_SCOPE BSTG_NAME *BSTG_FN(init)(BSTG_INIT_PARAMS)
+{
+    BSTG_NAME *t = malloc(sizeof *t);
+    if (t)
+    {
+        t->root = NULL;
+        t->size = 0;
+        BSTG_INIT(t);
+    }
+    return t;
+}
+
+BSTG_SCOPE void BSTG_FN(clear)(BSTG_NAME *t,
+        void (*callback)(BSTG_KEY, void*))
+{
+    BSTG_NODE *n, *p;
+
+    /* post-order, unlinking each node from its parent */
+    for (n = t->root; n; )
+    {
+        if (n->left)
+            n = n->left;
+        else if (n->right)
+            n = n->right;
+        else
+        {
+            if ((p = n->parent))
+            {
+                if (n == p->left)
+                    p->left = NULL;
+                else
+                    p->right = NULL;
+            }
+
+            if (callback)
+                callback(n->key, n->data);
+            free(n);
+            n = p;
+        }
+    }
+
+    t->root = NULL;
+    t->size = 0;
+}
+
+BSTG_SCOPE void BSTG_FN(free)(BSTG_NAME *t,
+        void (*callback)(BSTG_KEY, void*))
+{
+    if (!t)
+        return;
+
+    BSTG_FN(clear)(t, callback);
+    free(t);
+}
+
+BSTG_SCOPE size_t BSTG_FN(size)(BSTG_NAME *t)
+{
+    return t->size;
+}
+
+BSTG_SCOPE int BSTG_FN(insert)(BSTG_NAME *t, BSTG_KEY key, void *data)
+{
+    BSTG_NODE *n = t->root, *p = NULL;
+    int c = 0;
+
+    while (n)
+    {
+        /* no duplicates allowed */
+        if (!(c = BSTG_CMP(t, key, n->key)))
+            return -1;
+
+        p = n;
+        n = (c < 0) ? n->left : n->right;
+    }
+
+    if (!(n = malloc(sizeof *n)))
+        return -1;
+
+    n->key = key;
+    n->data = data;
+    n->parent = p;
+    n->left = NULL;
+    n->right = NULL;
+    n->red = 1;
+
+    if (!p)
+        t->root = n;
+    else if (c < 0)
+        p->left = n;
+    else
+        p->right = n;
+
+    t->size++;
+    BSTG_FN(insert_repair)(t, n);
+    return 0;
+}
+
+BSTG_SCOPE int BSTG_FN(remove)(BSTG_NAME *t, BSTG_KEY key,
+        void (*callback)(BSTG_KEY, void*))
+{
+    BSTG_NODE *n, *c, *p;
+
+    if (!(n = BSTG_FN(find)(t, key)))
+        return -1;
+
+    if (callback)
+        callback(n->key, n->data);
+
+    /* n has two children: take the successor's item and remove that */
+    if (n->left && n->right)
+    {
+        for (c = n->right; c->left; c = c->left)
+            ;
+        n->key = c->key;
+        n->data = c->data;
+        n = c;
+    }
+
+    /* replace n with its child (if any) */
+    c = (n->left) ? n->left : n->right;
+    p = n->parent;
+    if (c)
+        c->parent = p;
+
+    if (!p)
+        t->root = c;
+    else if (n == p->left)
+        p->left = c;
+    else
+        p->right = c;
+
+    if (!n->red)
+        BSTG_FN(remove_repair)(t, c, p);
+
+    free(n);
+    t->size--;
+    return 0;
+}
+
+BSTG_SCOPE int BSTG_FN(contains)(BSTG_NAME *t, BSTG_KEY key)
+{
+    return (BSTG_FN(find)(t, key) != NULL);
+}
+
+BSTG_SCOPE void *BSTG_FN(get)(BSTG_NAME *t, BSTG_KEY key)
+{
+    BSTG_NODE *n = BSTG_FN(find)(t, key);
+    return (n) ? n->data : NULL;
+}
+
+BSTG_SCOPE int BSTG_FN(min)(BSTG_NAME *t, BSTG_KEY *key, void **data)
+{
+    BSTG_NODE *n = t->root;
+
+    if (!n)
+        return -1;
+
+    while (n->left)
+        n = n->left;
+
+    if (key) *key = n->key;
+    if (data) *data = n->data;
+    return 0;
+}
+
+BSTG_SCOPE int BSTG_FN(max)(BSTG_NAME *t, BSTG_KEY *key, void **data)
+{
+    BSTG_NODE *n = t->root;
+
+    if (!n)
+        return -1;
+
+    while (n->right)
+        n = n->right;
+
+    if (key) *key = n->key;
+    if (data) *data = n->data;
+    return 0;
+}
+
+BSTG_SCOPE size_t BSTG_FN(range)(BSTG_NAME *t, BSTG_KEY lo, BSTG_KEY hi,
+        void (*callback)(BSTG_KEY, void*, void*), void *arg)
+{
+    BSTG_NODE *n, *first = NULL;
+    size_t count = 0;
+
+    /* first node with key >= lo */
+    for (n = t->root; n; )
+    {
+        if (BSTG_CMP(t, n->key, lo) >= 0)
+        {
+            first = n;
+            n = n->left;
+        }
+        else
+            n = n->right;
+    }
+
+    for (n = first; n && BSTG_CMP(t, n->key, hi) <= 0; n = BSTG_FN(next)(n))
+    {
+        if (callback)
+            callback(n->key, n->data, arg);
+        count++;
+    }
+    return count;
+}
+
+#endif
+
+
+#undef BSTG_NAME
+#undef BSTG_KEY
+#undef BSTG_CMP
+#undef BSTG_IMPLEMENT
+#undef BSTG_SCOPE
+#undef BSTG_FIELDS
+#undef BSTG_INIT_PARAMS
+#undef BSTG_INIT
@@ -0,0 +1,545 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cskiplist.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* removed nodes are freed two epochs later, see csl_retire() */
+#define N_EPOCHS 3
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+/* node of the skip list; lock protects its next pointers and the marked
+ * flag. A node is part of the map once linked is set and until marked
+ * is set */
+typedef struct cslnode cslnode;
+struct cslnode
+{
+    long key;
+    void *data;
+    /* index of the highest level */
+    int level;
+    volatile int marked;
+    volatile int linked;
+    pthread_mutex_t lock;
+    /* next node in the limbo list after removal */
+    cslnode *retired;
+    /* level + 1 entries */
+    cslnode *volatile next[1];
+};
+
+/* skip list object, a pointer to it is the first argument to all csl_
+ * functions */
+struct cskiplist
+{
+    /* sentinel with CSL_MAX_LEVEL levels */
+    cslnode *head;
+    volatile unsigned long seed;
+
+    /* epoch based reclamation: every operation registers in active[] for
+     * the current epoch; removed nodes wait in limbo[] */
+    volatile unsigned long epoch;
+    volatile long active[N_EPOCHS];
+    cslnode *limbo[N_EPOCHS];
+    pthread_mutex_t limbo_lock;
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* create a node with level + 1 levels */
+static cslnode *cslnode_init(long key, void *data, int level);
+
+/* destroy and free a node */
+static void cslnode_free(cslnode *n);
+
+/* random level, 0 with probability 1/2, 1 with 1/4... */
+static int csl_random_level(cskiplist *l);
+
+/* register/unregister a running operation, see struct cskiplist */
+static unsigned long csl_enter(cskiplist *l);
+static void csl_leave(cskiplist *l, unsigned long epoch);
+
+/* queue an unlinked node for freeing; frees nodes no operation can reach
+ * anymore */
+static void csl_retire(cskiplist *l, cslnode *n);
+
+/* store the predecessor and successor of key at each level in preds and
+ * succs; return the highest level where key was found or -1 */
+static int csl_find(cskiplist *l, long key, cslnode **preds, cslnode **succs);
+
+/* return the node with equal key if it is in the map, else NULL */
+static cslnode *csl_lookup(cskiplist *l, long key);
+
+/* unlock the (distinct) nodes preds[0..highest] */
+static void csl_unlock(cslnode **preds, int highest);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static cslnode *cslnode_init(long key, void *data, int level)
+{
+    cslnode *n = malloc(sizeof *n + level * sizeof n->next[0]);
+    int i;
+
+    if (!n)
+        return NULL;
+
+    if (pthread_mutex_init(&n->lock, NULL))
+    {
+        free(n);
+        return NULL;
+    }
+
+    n->key = key;
+    n->data = data;
+    n->level = level;
+    n->marked = 0;
+    n->linked = 0;
+    n->retired = NULL;
+    for (i = 0; i <= level; i++)
+        n->next[i] = NULL;
+
+    return n;
+}
+
+static void cslnode_free(cslnode *n)
+{
+    pthread_mutex_destroy(&n->lock);
+    free(n);
+}
+
+static int csl_random_level(cskiplist *l)
+{
+    unsigned long x = __sync_add_and_fetch(&l->seed, 0x9e3779b9UL);
+    int level = 0;
+
+    x ^= x >> 16;
+    x *= 0x85ebca6bUL;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35UL;
+    x ^= x >> 16;
+
+    while ((x & 1) && level < CSL_MAX_LEVEL - 1)
+    {
+        level++;
+        x >>= 1;
+    }
+    return level;
+}
+
+static unsigned long csl_enter(cskiplist *l)
+{
+    unsigned long e;
+
+    /* if the epoch changed in between, the counter might have been checked
+     * already */
+    for (;;)
+    {
+        e = l->epoch;
+        __sync_fetch_and_add(&l->active[e % N_EPOCHS], 1);
+        if (l->epoch == e)
+            return e;
+        __sync_fetch_and_sub(&l->active[e % N_EPOCHS], 1);
+    }
+}
+
+static void csl_leave(cskiplist *l, unsigned long epoch)
+{
+    __sync_fetch_and_sub(&l->active[epoch % N_EPOCHS], 1);
+}
+
+static void csl_retire(cskiplist *l, cslnode *n)
+{
+    cslnode *done = NULL, *next;
+    unsigned long e;
+
+    pthread_mutex_lock(&l->limbo_lock);
+
+    e = l->epoch;
+    n->retired = l->limbo[e % N_EPOCHS];
+    l->limbo[e % N_EPOCHS] = n;
+
+    /* once the operations of the previous epoch are done, nobody started
+     * before epoch e; so after advancing to e + 1, nobody can reach the
+     * nodes removed in e - 1 */
+    __sync_synchronize();
+    if (!l->active[(e + N_EPOCHS - 1) % N_EPOCHS])
+    {
+        l->epoch = e + 1;
+        done = l->limbo[(e + 2) % N_EPOCHS];
+        l->limbo[(e + 2) % N_EPOCHS] = NULL;
+        __sync_synchronize();
+    }
+
+    pthread_mutex_unlock(&l->limbo_lock);
+
+    for (; done; done = next)
+    {
+        next = done->retired;
+        cslnode_free(done);
+    }
+}
+
+static int csl_find(cskiplist *l, long key, cslnode **preds, cslnode **succs)
+{
+    cslnode *pred = l->head, *curr;
+    int level, found = -1;
+
+    for (level = CSL_MAX_LEVEL - 1; level >= 0; level--)
+    {
+        curr = pred->next[level];
+        while (curr && curr->key < key)
+        {
+            pred = curr;
+            curr = pred->next[level];
+        }
+
+        if (found == -1 && curr && curr->key == key)
+            found = level;
+
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return found;
+}
+
+static cslnode *csl_lookup(cskiplist *l, long key)
+{
+    cslnode *pred = l->head, *curr;
+    int level;
+
+    for (level = CSL_MAX_LEVEL - 1; level >= 0; level--)
+    {
+        curr = pred->next[level];
+        while (curr && curr->key < key)
+        {
+            pred = curr;
+            curr = pred->next[level];
+        }
+
+        if (curr && curr->key == key)
+            return (curr->linked && !curr->marked) ? curr : NULL;
+    }
+    return NULL;
+}
+
+static void csl_unlock(cslnode **preds, int highest)
+{
+    int i;
+
+    for (i = 0; i <= highest; i++)
+    {
+        if (!i || preds[i] != preds[i - 1])
+            pthread_mutex_unlock(&preds[i]->lock);
+    }
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+cskiplist *csl_init(void)
+{
+    cskiplist *l = malloc(sizeof *l);
+    int i;
+
+    if (!l)
+        return NULL;
+
+    if (!(l->head = cslnode_init(0, NULL, CSL_MAX_LEVEL - 1)))
+    {
+        free(l);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&l->limbo_lock, NULL))
+    {
+        cslnode_free(l->head);
+        free(l);
+        return NULL;
+    }
+
+    l->seed = (unsigned long)l;
+    l->epoch = 0;
+    for (i = 0; i < N_EPOCHS; i++)
+    {
+        l->active[i] = 0;
+        l->limbo[i] = NULL;
+    }
+
+    return l;
+}
+
+void csl_clear(cskiplist *l, void (*callback)(void*))
+{
+    cslnode *n, *next;
+    int i;
+
+    if (!l)
+        return;
+
+    for (n = l->head->next[0]; n; n = next)
+    {
+        next = n->next[0];
+        if (callback)
+            callback(n->data);
+        cslnode_free(n);
+    }
+
+    for (i = 0; i < CSL_MAX_LEVEL; i++)
+        l->head->next[i] = NULL;
+
+    for (i = 0; i < N_EPOCHS; i++)
+    {
+        for (n = l->limbo[i]; n; n = next)
+        {
+            next = n->retired;
+            cslnode_free(n);
+        }
+        l->limbo[i] = NULL;
+    }
+}
+
+void csl_free(cskiplist *l, void (*callback)(void*))
+{
+    if (!l)
+        return;
+
+    csl_clear(l, callback);
+    cslnode_free(l->head);
+    pthread_mutex_destroy(&l->limbo_lock);
+    free(l);
+}
+
+int csl_insert(cskiplist *l, long key, void *data)
+{
+    cslnode *preds[CSL_MAX_LEVEL], *succs[CSL_MAX_LEVEL];
+    cslnode *n, *found, *pred, *succ;
+    int level, highest, valid, top = csl_random_level(l);
+    unsigned long e;
+
+    if (!(n = cslnode_init(key, data, top)))
+        return -1;
+
+    e = csl_enter(l);
+
+    for (;;)
+    {
+        if ((level = csl_find(l, key, preds, succs)) != -1)
+        {
+            found = succs[level];
+
+            /* being removed, try again */
+            if (found->marked)
+                continue;
+
+            /* no duplicates allowed; wait until a concurrent insert of
+             * the same key is complete */
+            while (!found->linked)
+                ;
+            csl_leave(l, e);
+            cslnode_free(n);
+            return -1;
+        }
+
+        /* lock the predecessors bottom-up, then check that nothing changed
+         * since csl_find() */
+        valid = 1;
+        for (level = highest = 0; valid && level <= top; level++)
+        {
+            pred = preds[level];
+            succ = succs[level];
+
+            if (!level || pred != preds[level - 1])
+                pthread_mutex_lock(&pred->lock);
+            highest = level;
+
+            valid = !pred->marked && (!succ || !succ->marked) &&
+                pred->next[level] == succ;
+        }
+
+        if (!valid)
+        {
+            csl_unlock(preds, highest);
+            continue;
+        }
+
+        for (level = 0; level <= top; level++)
+            n->next[level] = succs[level];
+
+        /* n must be complete before it becomes reachable */
+        __sync_synchronize();
+        for (level = 0; level <= top; level++)
+            preds[level]->next[level] = n;
+
+        __sync_synchronize();
+        n->linked = 1;
+
+        csl_unlock(preds, highest);
+        csl_leave(l, e);
+        return 0;
+    }
+}
+
+int csl_remove(cskiplist *l, long key, void (*callback)(void*))
+{
+    cslnode *preds[CSL_MAX_LEVEL], *succs[CSL_MAX_LEVEL];
+    cslnode *victim = NULL, *pred;
+    int level, highest, valid, top = -1;
+    unsigned long e = csl_enter(l);
+
+    for (;;)
+    {
+        level = csl_find(l, key, preds, succs);
+
+        /* logically remove the node by marking it */
+        if (!victim)
+        {
+            if (level == -1 ||
+                    !succs[level]->linked ||
+                    succs[level]->level != level ||
+                    succs[level]->marked)
+                break;
+
+            victim = succs[level];
+            top = victim->level;
+
+            pthread_mutex_lock(&victim->lock);
+            if (victim->marked)
+            {
+                pthread_mutex_unlock(&victim->lock);
+                break;
+            }
+            victim->marked = 1;
+        }
+
+        valid = 1;
+        for (level = highest = 0; valid && level <= top; level++)
+        {
+            pred = preds[level];
+
+            if (!level || pred != preds[level - 1])
+                pthread_mutex_lock(&pred->lock);
+            highest = level;
+
+            valid = !pred->marked && pred->next[level] == victim;
+        }
+
+        if (!valid)
+        {
+            csl_unlock(preds, highest);
+            continue;
+        }
+
+        /* unlink top-down */
+        for (level = top; level >= 0; level--)
+            preds[level]->next[level] = victim->next[level];
+
+        pthread_mutex_unlock(&victim->lock);
+        csl_unlock(preds, highest);
+
+        if (callback)
+            callback(victim->data);
+
+        csl_leave(l, e);
+        csl_retire(l, victim);
+        return 0;
+    }
+
+    csl_leave(l, e);
+    return -1;
+}
+
+int csl_contains(cskiplist *l, long key)
+{
+    unsigned long e = csl_enter(l);
+    int found = (csl_lookup(l, key) != NULL);
+
+    csl_leave(l, e);
+    return found;
+}
+
+void *csl_get(cskiplist *l, long key)
+{
+    unsigned long e = csl_enter(l);
+    cslnode *n = csl_lookup(l, key);
+    void *data = (n) ? n->data : NULL;
+
+    csl_leave(l, e);
+    return data;
+}
+
+size_t csl_range(cskiplist *l, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg)
+{
+    cslnode *pred = l->head, *curr;
+    size_t count = 0;
+    int level;
+    unsigned long e = csl_enter(l);
+
+    for (level = CSL_MAX_LEVEL - 1; level >= 0; level--)
+    {
+        curr = pred->next[level];
+        while (curr && curr->key < lo)
+        {
+            pred = curr;
+            curr = pred->next[level];
+        }
+    }
+
+    /* removed nodes keep their next pointers, so the scan can continue
+     * from them */
+    for (curr = pred->next[0]; curr && curr->key <= hi; curr = curr->next[0])
+    {
+        if (curr->linked && !curr->marked)
+        {
+            if (callback)
+                callback(curr->key, curr->data, arg);
+            count++;
+        }
+    }
+
+    csl_leave(l, e);
+    return count;
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CSKIPLIST_H
+#define CSKIPLIST_H
+
+/* concurrent ordered map with long keys (lazy skip list). All operations
+ * but csl_clear() and csl_free() may be called from several threads at
+ * once. Insert, remove and lookups are linearizable; lookups don't take
+ * any locks. Range scans are weakly consistent: they see every item that
+ * is present during the whole scan and none that is absent during the
+ * whole scan */
+
+#include <stddef.h>
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* maximum number of levels of a node */
+#ifndef CSL_MAX_LEVEL
+#define CSL_MAX_LEVEL 24
+#endif
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct cskiplist cskiplist;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* initialize skip list */
+cskiplist *csl_init(void);
+
+/* remove all items from the list; must not run concurrently with any
+ * other operation on the list */
+void csl_clear(cskiplist *l, void (*callback)(void*));
+
+/* free a skip list; same restriction as csl_clear() */
+void csl_free(cskiplist *l, void (*callback)(void*));
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* insert an item; returns -1 if an item with equal key exists or on
+ * allocation failure */
+int csl_insert(cskiplist *l, long key, void *data);
+
+/* delete item with equal key; callback is called on its data right away,
+ * so it must not free data that other threads might still use */
+int csl_remove(cskiplist *l, long key, void (*callback)(void*));
+
+/* return non-zero if there's an item with equal key */
+int csl_contains(cskiplist *l, long key);
+
+/* get item with equal key */
+void *csl_get(cskiplist *l, long key);
+
+/* call callback(key, data, arg) on the items with lo <= key <= hi in
+ * ascending order; returns the number of items */
+size_t csl_range(cskiplist *l, long lo, long hi,
+        void (*callback)(long, void*, void*), void *arg);
+
+#endif
@@ -0,0 +1,63 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GBST_H
+#define GBST_H
+
+/* ordered map with generic keys (void pointers) and a user comparison
+ * function, generated from bstgen.h. For long keys, bst is faster; for
+ * other fixed key types, a tree generated with an inline comparison (see
+ * bstgen.h) avoids the function call per comparison */
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+/* compare the keys passed as first and second argument, returning < 0, 0
+ * or > 0 if the first one is smaller, equal or greater. The third argument
+ * is the one passed to gbst_init() and might be NULL */
+typedef int (*gbst_cmpfunc_t) (const void*, const void*, const void*);
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/* gbst_init(cmp, arg), gbst_clear(), gbst_free(), gbst_size(),
+ * gbst_insert(), gbst_remove(), gbst_contains(), gbst_get(), gbst_min(),
+ * gbst_max() and gbst_range(), working like the bst_ ones; callbacks get
+ * the key along with the data */
+#define BSTG_NAME gbst
+#define BSTG_KEY const void*
+#define BSTG_CMP(t, a, b) ((t)->cmp((a), (b), (t)->arg))
+#define BSTG_FIELDS gbst_cmpfunc_t cmp; const void *arg;
+#define BSTG_INIT_PARAMS gbst_cmpfunc_t cmp, const void *arg
+#define BSTG_INIT(t) ((t)->cmp = cmp, (t)->arg = arg)
+#include "bstgen.h"
+
+#endif
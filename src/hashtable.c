@@ -23,6 +23,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "hashtable.h"
+#include "htcuckoo.h"
+#include "htfilter.h"
 #include "pgroups.h"
 
 #include <stdlib.h>
@@ -41,6 +43,24 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define FREE_KEY(p) if (free_key) free_key(p)
 #define FREE_DATA(p) if (free_data) free_data(p)
 
+/* number of items stored inside the hashtable object with HT_SMALL */
+#ifndef HT_SMALL_ITEMS
+#define HT_SMALL_ITEMS 4
+#endif
+
+/* hashtable uses its single inline bucket (see HT_SMALL) */
+#define HT_IS_SMALL(ht) ((ht)->buckets == &(ht)->small)
+
+/* number of items that triggers growing the hashtable */
+#define HT_CAPACITY(ht) (HT_IS_SMALL(ht) ? HT_SMALL_ITEMS : (ht)->n_buckets)
+
+/* items allocated behind the hashtable object with HT_SMALL */
+#define HT_INLINE_ITEMS(ht) ((struct htbucket_item*)((ht) + 1))
+#define HT_N_INLINE(ht) (((ht)->options & HT_SMALL) ? HT_SMALL_ITEMS : 0)
+
+/* key of inline items in the pool while htitem_free_pool() runs */
+#define HTITEM_INLINE ((void*)&htitem_inline)
+
 #define RAND(min, max) ((rand() % (max)-(min)) + (min))
 #define PRIME(group) (primes[group][RAND(0,PGROUP_ELEMENTS)])
 
@@ -57,7 +77,23 @@ struct hashtable
     size_t n_items;
     size_t n_buckets;
     size_t pgroup;
+    int options;
     struct htbucket *buckets;
+    /* unused bucket items (key == NULL), kept for reuse; trimmed when the
+     * hashtable shrinks */
+    struct htbucket_item *pool;
+    /* used instead of buckets with HT_CUCKOO */
+    htcuckoo *cuckoo;
+    /* see ht_filter(); filter_stale counts removed items still in it */
+    htfilter *filter;
+    double filter_fp_rate;
+    size_t filter_stale;
+    /* only bucket with HT_SMALL until the first resize; its items are
+     * allocated right behind the hashtable object */
+    struct htbucket
+    {
+        struct htbucket_item *root;
+    } small;
 };
 
 struct htiter
@@ -65,12 +101,12 @@ struct htiter
     struct hashtable *ht;
     size_t b;
     struct htbucket_item *cur;
+    /* only set by ht_get_all_a(): iterate over pairs with equal key */
+    const void *key;
+    const void *cmp_arg;
 };
 
-typedef struct htbucket
-{
-    struct htbucket_item *root;
-} htbucket;
+typedef struct htbucket htbucket;
 
 struct htbucket_item
 {
@@ -79,6 +115,9 @@ struct htbucket_item
     struct htbucket_item *next;
 };
 
+/* only its address is used, see HTITEM_INLINE */
+static char htitem_inline;
+
 
 /*===================*/
 /* static prototypes */
@@ -94,6 +133,42 @@ static int ht_strcmp(const void *key1, const void *key2, const void *arg);
 static int ht_resize(hashtable *ht, int grow);
 static htbucket *ht_alloc_buckets(size_t n);
 
+/* return the bucket for key, NULL if no buckets are allocated yet */
+static htbucket *ht_bucket(hashtable *ht, const void *key, const void *hash_arg);
+
+/* return the bucket that might contain key, NULL if key is definitely not
+ * in the hashtable (no buckets allocated or rejected by the filter) */
+static htbucket *ht_find_bucket(hashtable *ht, const void *key, const void *hash_arg);
+
+/* return the position of key with HT_CUCKOO or HTC_NONE */
+static size_t ht_find_cuckoo(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg);
+
+/* rebuild the filter from all items */
+static int ht_filter_rebuild(hashtable *ht);
+
+/* update the filter after inserting key */
+static void ht_filter_inserted(hashtable *ht, const void *key, const void *hash_arg);
+
+/* update the filter after removing n items */
+static void ht_filter_removed(hashtable *ht, size_t n);
+
+
+/*-------------------*/
+/* bucket item funcs */
+/*-------------------*/
+
+/* take an item from the pool or allocate a new one */
+static struct htbucket_item *htitem_alloc(struct htbucket_item **pool);
+
+/* put an item into the pool for later reuse */
+static void htitem_release(struct htbucket_item **pool, struct htbucket_item *p);
+
+/* free the items in the pool except for the first n_spare ones and the
+ * n_inline items (which are not malloc()ed) at inline */
+static void htitem_free_pool(struct htbucket_item **pool,
+        struct htbucket_item *inline_items, size_t n_inline, size_t n_spare);
+
 
 /*--------------*/
 /* bucket funcs */
@@ -101,8 +176,13 @@ static htbucket *ht_alloc_buckets(size_t n);
 
 static int htbucket_empty(htbucket *b);
 
-/* insert item into bucket */
+/* insert item into bucket; if multi is non-zero, equal keys are allowed */
 static int htbucket_insert(htbucket *b, void *key, void *data,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg,
+        int multi, struct htbucket_item **pool);
+
+/* return first bucket item with given key */
+static struct htbucket_item *htbucket_find(htbucket *b, const void *key,
         int (*cmp)(const void*, const void*, const void*), const void *cmp_arg);
 
 /* return data from bucket item with given key */
@@ -112,20 +192,85 @@ static void *htbucket_get(htbucket *b, const void *key,
 /* remove and return item with the given key */
 static int htbucket_remove(htbucket *b, void **data, const void *key,
         int (*cmp)(const void*, const void*, const void*), const void *cmp_arg,
-        void (*free_key)(void*));
+        void (*free_key)(void*), struct htbucket_item **pool);
+
+/* remove all items with the given key, return number of removed items */
+static size_t htbucket_remove_all(htbucket *b, const void *key,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg,
+        void (*free_key)(void*), void (*free_data)(void*),
+        struct htbucket_item **pool);
 
 /* remove first item from bucket, storing key and data in the passed pointers */
-static void *htbucket_pop(htbucket *b, void **key, void **data);
+static void *htbucket_pop(htbucket *b, void **key, void **data,
+        struct htbucket_item **pool);
 
 /* remove all items from the bucket, using the passed free_*() functions on key and data */
 static void htbucket_clear(htbucket *b,
-        void (*free_key)(void*), void (*free_data)(void*));
+        void (*free_key)(void*), void (*free_data)(void*),
+        struct htbucket_item **pool);
 
 
 /********************/
 /* STATIC FUNCTIONS */
 /********************/
 
+/*=======================*/
+/* bucket item functions */
+/*=======================*/
+
+static struct htbucket_item *htitem_alloc(struct htbucket_item **pool)
+{
+    struct htbucket_item *p = *pool;
+
+    if (p)
+        *pool = p->next;
+    else
+        p = malloc(sizeof *p);
+
+    return p;
+}
+
+static void htitem_release(struct htbucket_item **pool, struct htbucket_item *p)
+{
+    p->key = NULL;
+    p->next = *pool;
+    *pool = p;
+}
+
+static void htitem_free_pool(struct htbucket_item **pool,
+        struct htbucket_item *inline_items, size_t n_inline, size_t n_spare)
+{
+    struct htbucket_item **p, *del;
+    size_t i;
+
+    /* keys are never NULL, so these are exactly the pooled inline items */
+    for (i = 0; i < n_inline; i++)
+    {
+        if (!inline_items[i].key)
+            inline_items[i].key = HTITEM_INLINE;
+    }
+
+    for (p = pool; *p; )
+    {
+        if ((*p)->key == HTITEM_INLINE)
+        {
+            (*p)->key = NULL;
+            p = &(*p)->next;
+        }
+        else if (n_spare)
+        {
+            n_spare--;
+            p = &(*p)->next;
+        }
+        else
+        {
+            del = *p;
+            *p = del->next;
+            free(del);
+        }
+    }
+}
+
 /*==================*/
 /* bucket functions */
 /*==================*/
@@ -137,12 +282,13 @@ static int htbucket_empty(htbucket *b)
 }
 
 static int htbucket_insert(htbucket *b, void *key, void *data,
-        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg)
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg,
+        int multi, struct htbucket_item **pool)
 {
     struct htbucket_item *p, *ins;
 
     /* initialize item */
-    ins = malloc(sizeof *ins);
+    ins = htitem_alloc(pool);
     if (!ins)
         return HT_ERROR;
 
@@ -156,28 +302,34 @@ static int htbucket_insert(htbucket *b, void *key, void *data,
         b->root = ins;
         return HT_OK;
     }
-    /* compare with root */
-    else if (cmp(key, b->root->key, cmp_arg) == 0)
-    {
-        free(ins);
-        return HT_EXIST;
-    }
 
-    /* compare with child until p is last item */
-    for (p = b->root; p->next; p = p->next)
+    /* compare with items until p is last item */
+    for (p = b->root; ; p = p->next)
     {
-        if (cmp(key, p->next->key, cmp_arg) == 0)
+        if (cmp(key, p->key, cmp_arg) == 0)
         {
-            free(ins);
-            return HT_EXIST;
+            if (!multi)
+            {
+                htitem_release(pool, ins);
+                return HT_EXIST;
+            }
+
+            /* keep equal keys adjacent: append to the end of their run */
+            while (p->next && cmp(key, p->next->key, cmp_arg) == 0)
+                p = p->next;
+            break;
         }
+
+        if (!p->next)
+            break;
     }
 
+    ins->next = p->next;
     p->next = ins;
     return HT_OK;
 }
 
-static void *htbucket_get(htbucket *b, const void *key,
+static struct htbucket_item *htbucket_find(htbucket *b, const void *key,
         int (*cmp)(const void*, const void*, const void*), const void *cmp_arg)
 {
     struct htbucket_item *p;
@@ -185,14 +337,22 @@ static void *htbucket_get(htbucket *b, const void *key,
     for (p = b->root; p; p = p->next)
     {
         if (cmp(key, p->key, cmp_arg) == 0)
-            return p->data;
+            return p;
     }
     return NULL;
 }
 
+static void *htbucket_get(htbucket *b, const void *key,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg)
+{
+    struct htbucket_item *p = htbucket_find(b, key, cmp, cmp_arg);
+
+    return (p) ? p->data : NULL;
+}
+
 static int htbucket_remove(htbucket *b, void **data, const void *key,
         int (*cmp)(const void*, const void*, const void*), const void *cmp_arg,
-        void (*free_key)(void*))
+        void (*free_key)(void*), struct htbucket_item **pool)
 {
     struct htbucket_item *p, *del;
 
@@ -204,7 +364,7 @@ static int htbucket_remove(htbucket *b, void **data, const void *key,
         b->root = del->next;
         *data = del->data;
         FREE_KEY(del->key);
-        free(del);
+        htitem_release(pool, del);
         return HT_OK;
     }
 
@@ -216,14 +376,42 @@ static int htbucket_remove(htbucket *b, void **data, const void *key,
             p->next = del->next;
             *data = del->data;
             FREE_KEY(del->key);
-            free(del);
+            htitem_release(pool, del);
             return HT_OK;
         }
     }
     return HT_ERROR;
 }
 
-static void *htbucket_pop(htbucket *b, void **key, void **data)
+static size_t htbucket_remove_all(htbucket *b, const void *key,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg,
+        void (*free_key)(void*), void (*free_data)(void*),
+        struct htbucket_item **pool)
+{
+    struct htbucket_item **p, *del;
+    size_t n = 0;
+
+    /* skip to the start of the run of equal keys */
+    for (p = &b->root; *p; p = &(*p)->next)
+    {
+        if (cmp(key, (*p)->key, cmp_arg) == 0)
+            break;
+    }
+
+    while (*p && cmp(key, (*p)->key, cmp_arg) == 0)
+    {
+        del = *p;
+        *p = del->next;
+        FREE_KEY(del->key);
+        FREE_DATA(del->data);
+        htitem_release(pool, del);
+        n++;
+    }
+    return n;
+}
+
+static void *htbucket_pop(htbucket *b, void **key, void **data,
+        struct htbucket_item **pool)
 {
     struct htbucket_item *p;
 
@@ -239,12 +427,13 @@ static void *htbucket_pop(htbucket *b, void **key, void **data)
 
     *key = p->key;
     *data = p->data;
-    free(p);
+    htitem_release(pool, p);
 
     return *data;
 }
 
-static void htbucket_clear(htbucket *b, void (*free_key)(void*),  void (*free_data)(void*))
+static void htbucket_clear(htbucket *b, void (*free_key)(void*),  void (*free_data)(void*),
+        struct htbucket_item **pool)
 {
     struct htbucket_item *p, *del;
 
@@ -257,8 +446,9 @@ static void htbucket_clear(htbucket *b, void (*free_key)(void*),  void (*free_da
 
         FREE_KEY(del->key);
         FREE_DATA(del->data);
-        free(del);
+        htitem_release(pool, del);
     }
+    b->root = NULL;
 }
 
 /*==================================*/
@@ -331,7 +521,14 @@ static int ht_resize(hashtable *ht, int grow)
     htbucket *newbuckets;
     void *key, *data;
 
-    if (grow)
+    if (!ht->buckets || HT_IS_SMALL(ht))
+    {
+        /* allocate buckets for the first time */
+        if (!grow)
+            return HT_OK;
+        pg = 0;
+    }
+    else if (grow)
     {
         if (ht->pgroup >= PGROUP_COUNT-1)
             return HT_OK;
@@ -355,7 +552,7 @@ static int ht_resize(hashtable *ht, int grow)
     {
         while (1)
         {
-            htbucket_pop(ht->buckets + i, &key, &data);
+            htbucket_pop(ht->buckets + i, &key, &data, &ht->pool);
             /* no more items in bucket */
             if (!key)
                 break;
@@ -365,18 +562,116 @@ static int ht_resize(hashtable *ht, int grow)
             /* meh, errors here are ignored
              * ENOMEM occurs, you have other problems
              */
-            htbucket_insert(newbuckets + k, key, data, ht->cmp, NULL);
+            htbucket_insert(newbuckets + k, key, data, ht->cmp, NULL,
+                    ht->options & HT_MULTI, &ht->pool);
         }
     }
 
-    free(ht->buckets);
+    if (!HT_IS_SMALL(ht))
+        free(ht->buckets);
     ht->buckets = newbuckets;
     ht->n_buckets = n;
     ht->pgroup = pg;
 
+    /* shrinking (i.e. no HT_NOSHRINK): don't hold on to the items of the
+     * peak size, keep at most one spare item per stored item */
+    if (!grow)
+        htitem_free_pool(&ht->pool, HT_INLINE_ITEMS(ht), HT_N_INLINE(ht),
+                ht->n_items);
+
+    return HT_OK;
+}
+
+static htbucket *ht_bucket(hashtable *ht, const void *key, const void *hash_arg)
+{
+    /* don't bother hashing if there's only one (or no) bucket */
+    if (ht->n_buckets <= 1)
+        return ht->buckets;
+
+    return ht->buckets + ht->hash(key, hash_arg) % ht->n_buckets;
+}
+
+static htbucket *ht_find_bucket(hashtable *ht, const void *key, const void *hash_arg)
+{
+    hash_t h;
+
+    if (!ht->filter)
+        return ht_bucket(ht, key, hash_arg);
+
+    h = ht->hash(key, hash_arg);
+    if (!ht->buckets || !htf_contains(ht->filter, h))
+        return NULL;
+
+    return ht->buckets + h % ht->n_buckets;
+}
+
+static size_t ht_find_cuckoo(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg)
+{
+    hash_t h = ht->hash(key, hash_arg);
+
+    if (ht->filter && !htf_contains(ht->filter, h))
+        return HTC_NONE;
+
+    return htc_find(ht->cuckoo, h, key, ht->cmp, cmp_arg);
+}
+
+static int ht_filter_rebuild(hashtable *ht)
+{
+    htfilter *f;
+    struct htbucket_item *p;
+    size_t i;
+    void *key, *data;
+
+    /* leave room to grow before the next rebuild */
+    f = htf_init(2 * ht->n_items, ht->filter_fp_rate);
+    if (!f)
+        return HT_ERROR;
+
+    /* like ht_resize(), keys are hashed without hash_arg */
+    if (ht->cuckoo)
+    {
+        i = 0;
+        while (htc_next(ht->cuckoo, &i, &key, &data))
+            htf_add(f, ht->hash(key, NULL));
+    }
+
+    for (i = 0; i < ht->n_buckets; i++)
+    {
+        for (p = ht->buckets[i].root; p; p = p->next)
+            htf_add(f, ht->hash(p->key, NULL));
+    }
+
+    htf_free(ht->filter);
+    ht->filter = f;
+    ht->filter_stale = 0;
     return HT_OK;
 }
 
+static void ht_filter_inserted(hashtable *ht, const void *key, const void *hash_arg)
+{
+    if (!ht->filter)
+        return;
+
+    /* more items than the filter was built for -> rising fp rate */
+    if (ht->n_items > htf_capacity(ht->filter))
+        ht_filter_rebuild(ht);
+
+    htf_add(ht->filter, ht->hash(key, hash_arg));
+}
+
+static void ht_filter_removed(hashtable *ht, size_t n)
+{
+    if (!ht->filter)
+        return;
+
+    /* removed items can't be deleted from the filter, so rebuild it once
+     * there are too many of them */
+    ht->filter_stale += n;
+    if (ht->filter_stale > htf_capacity(ht->filter) / 2)
+        ht_filter_rebuild(ht);
+}
+
 
 /**********************/
 /* EXPORTED FUNCTIONS */
@@ -394,13 +689,18 @@ void ht_statistics(hashtable *ht, int *n_items, int *n_buckets, int *empty, int
 
     *empty = *one = *gtone = *max = 0;
     *n_items = ht->n_items;
-    *n_buckets = ht->n_buckets;
+    *n_buckets = (ht->cuckoo) ? htc_n_buckets(ht->cuckoo) : ht->n_buckets;
 
-    for (i=0; i<ht->n_buckets; i++)
+    for (i=0; i<*n_buckets; i++)
     {
         n = 0;
-        for (bi = ht->buckets[i].root; bi; bi = bi->next)
-            n++;
+        if (ht->cuckoo)
+            n = htc_bucket_items(ht->cuckoo, i);
+        else
+        {
+            for (bi = ht->buckets[i].root; bi; bi = bi->next)
+                n++;
+        }
 
         switch (n) {
             case 0:
@@ -417,7 +717,7 @@ void ht_statistics(hashtable *ht, int *n_items, int *n_buckets, int *empty, int
             *max = n;
     }
 
-    *avg = (double)ht->n_items / (ht->n_buckets - *empty);
+    *avg = (*n_buckets > *empty) ? (double)ht->n_items / (*n_buckets - *empty) : 0.0;
 }
 
 /*------------*/
@@ -427,8 +727,18 @@ void ht_statistics(hashtable *ht, int *n_items, int *n_buckets, int *empty, int
 int ht_init_f(hashtable **ht, hash_t (*hashfunc)(const void*, const void*),
         int (*cmpfunc)(const void*, const void*, const void*),
         void (*free_key)(void*), void (*free_data)(void*))
+{
+    return ht_init_fo(ht, hashfunc, cmpfunc, free_key, free_data, 0);
+}
+
+int ht_init_fo(hashtable **ht, hash_t (*hashfunc)(const void*, const void*),
+        int (*cmpfunc)(const void*, const void*, const void*),
+        void (*free_key)(void*), void (*free_data)(void*),
+        int options)
 {
     hashtable *p;
+    struct htbucket_item *items;
+    size_t n;
 
     /* if both func pointers are NULL use default string hash/cmp */
     if (!hashfunc && !cmpfunc)
@@ -443,7 +753,15 @@ int ht_init_f(hashtable **ht, hash_t (*hashfunc)(const void*, const void*),
         return HT_ERROR;
     }
 
-    p = malloc(sizeof *p);
+    /* cuckoo hashing has neither chains nor inline items */
+    if ((options & HT_CUCKOO) && (options & (HT_MULTI | HT_SMALL)))
+    {
+        *ht = NULL;
+        return HT_ERROR;
+    }
+
+    n = (options & HT_SMALL) ? HT_SMALL_ITEMS : 0;
+    p = malloc(sizeof *p + n * sizeof *items);
 
     if (!p)
     {
@@ -454,8 +772,9 @@ int ht_init_f(hashtable **ht, hash_t (*hashfunc)(const void*, const void*),
     srand(time(NULL));
 
     p->n_items = 0;
-    p->n_buckets = PRIME(0);
+    p->n_buckets = 0;
     p->pgroup = 0;
+    p->options = options;
 
     p->hash = hashfunc;
     p->cmp = cmpfunc;
@@ -463,15 +782,35 @@ int ht_init_f(hashtable **ht, hash_t (*hashfunc)(const void*, const void*),
     p->free_key = free_key;
     p->free_data = free_data;
 
-    p->buckets = ht_alloc_buckets(p->n_buckets);
+    p->pool = NULL;
+    p->cuckoo = NULL;
+    p->filter = NULL;
+    p->filter_stale = 0;
+    p->small.root = NULL;
 
-    if (!p->buckets)
+    if ((options & HT_CUCKOO) && !(p->cuckoo = htc_init()))
     {
         free(p);
         *ht = NULL;
         return HT_ERROR;
     }
 
+    if (options & HT_SMALL)
+    {
+        /* use the items behind the object until the first resize */
+        items = HT_INLINE_ITEMS(p);
+        while (n--)
+            htitem_release(&p->pool, items + n);
+
+        p->buckets = &p->small;
+        p->n_buckets = 1;
+    }
+    else
+    {
+        /* buckets are allocated on first insert */
+        p->buckets = NULL;
+    }
+
     *ht = p;
     return HT_OK;
 }
@@ -490,19 +829,56 @@ void ht_free(hashtable *ht)
 }
 
 void ht_free_f(hashtable *ht, void (*free_key)(void*), void (*free_data)(void*))
+{
+    if (!ht)
+        return;
+
+    ht_clear_f(ht, free_key, free_data);
+
+    htitem_free_pool(&ht->pool, HT_INLINE_ITEMS(ht), HT_N_INLINE(ht), 0);
+    if (!HT_IS_SMALL(ht))
+        free(ht->buckets);
+    htc_free(ht->cuckoo, NULL, NULL);
+    htf_free(ht->filter);
+
+    free(ht);
+}
+
+
+/*-------*/
+/* clear */
+/*-------*/
+
+void ht_clear(hashtable *ht)
+{
+    if (!ht)
+        return;
+
+    ht_clear_f(ht, ht->free_key, ht->free_data);
+}
+
+void ht_clear_f(hashtable *ht, void (*free_key)(void*), void (*free_data)(void*))
 {
     size_t n;
 
     if (!ht)
         return;
 
+    if (ht->cuckoo)
+        htc_clear(ht->cuckoo, free_key, free_data);
+
+    if (ht->filter)
+    {
+        htf_clear(ht->filter);
+        ht->filter_stale = 0;
+    }
+
+    /* buckets and items are kept for reuse */
     n = ht->n_buckets;
     while (n--)
-        htbucket_clear(ht->buckets + n, free_key, free_data);
+        htbucket_clear(ht->buckets + n, free_key, free_data, &ht->pool);
 
-    free(ht->buckets);
-
-    free(ht);
+    ht->n_items = 0;
 }
 
 
@@ -545,20 +921,34 @@ int ht_insert_a(hashtable *ht, void *key, void *data,
         const void *hash_arg, const void *cmp_arg)
 {
     int res;
-    hash_t k;
 
     if (!ht || !key)
         return HT_ERROR;
 
-    k = ht->hash(key, hash_arg) % ht->n_buckets;
+    if (ht->cuckoo)
+    {
+        res = htc_insert(ht->cuckoo, ht->hash(key, hash_arg), key, data,
+                ht->cmp, cmp_arg);
+        if (res == HT_OK)
+        {
+            ht->n_items++;
+            ht_filter_inserted(ht, key, hash_arg);
+        }
+        return res;
+    }
 
-    res = htbucket_insert(ht->buckets + k, key, data, ht->cmp, cmp_arg);
+    if (!ht->buckets && ht_resize(ht, 1) != HT_OK)
+        return HT_ERROR;
+
+    res = htbucket_insert(ht_bucket(ht, key, hash_arg), key, data,
+            ht->cmp, cmp_arg, ht->options & HT_MULTI, &ht->pool);
 
     if (res == HT_OK)
     {
         ht->n_items++;
-        if (ht->n_items > ht->n_buckets)
+        if (ht->n_items > HT_CAPACITY(ht))
             ht_resize(ht, 1);
+        ht_filter_inserted(ht, key, hash_arg);
     }
 
     return res;
@@ -572,13 +962,84 @@ int ht_insert_a(hashtable *ht, void *key, void *data,
 void *ht_get_a(hashtable *ht, const void *key,
         const void *hash_arg, const void *cmp_arg)
 {
-    hash_t k;
+    htbucket *b;
+    size_t pos;
+    void *k, *data;
+
+    if (!ht || !key)
+        return NULL;
+
+    if (ht->cuckoo)
+    {
+        pos = ht_find_cuckoo(ht, key, hash_arg, cmp_arg);
+        if (pos == HTC_NONE)
+            return NULL;
+
+        htc_at(ht->cuckoo, pos, &k, &data);
+        return data;
+    }
+
+    if (!(b = ht_find_bucket(ht, key, hash_arg)))
+        return NULL;
+
+    return htbucket_get(b, key, ht->cmp, cmp_arg);
+}
+
+htiter *ht_get_all_a(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg)
+{
+    htbucket *b;
+    htiter *it;
 
     if (!ht || !key)
         return NULL;
 
-    k = ht->hash(key, hash_arg) % ht->n_buckets;
-    return htbucket_get(ht->buckets + k, key, ht->cmp, cmp_arg);
+    it = ht_iter(ht);
+    if (it && ht->cuckoo)
+    {
+        /* it->b is the position of the only item to return */
+        it->b = ht_find_cuckoo(ht, key, hash_arg, cmp_arg);
+        it->key = key;
+        it->cmp_arg = cmp_arg;
+    }
+    else if (it)
+    {
+        b = ht_find_bucket(ht, key, hash_arg);
+        it->cur = (b) ? htbucket_find(b, key, ht->cmp, cmp_arg) : NULL;
+        it->key = key;
+        it->cmp_arg = cmp_arg;
+    }
+    return it;
+}
+
+
+/*-------*/
+/* count */
+/*-------*/
+
+size_t ht_count_a(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg)
+{
+    htbucket *b;
+    struct htbucket_item *p;
+    size_t n = 0;
+
+    if (!ht || !key)
+        return 0;
+
+    if (ht->cuckoo)
+        return ht_find_cuckoo(ht, key, hash_arg, cmp_arg) != HTC_NONE;
+
+    if (!(b = ht_find_bucket(ht, key, hash_arg)))
+        return 0;
+
+    p = htbucket_find(b, key, ht->cmp, cmp_arg);
+
+    /* equal keys are adjacent */
+    for (; p && ht->cmp(key, p->key, cmp_arg) == 0; p = p->next)
+        n++;
+
+    return n;
 }
 
 
@@ -599,21 +1060,40 @@ void *ht_remove_fa(hashtable *ht, const void *key,
         void (*free_key)(void*),
         const void *hash_arg, const void *cmp_arg)
 {
-    hash_t k;
+    htbucket *b;
     int res;
-    void *data;
+    size_t pos;
+    void *k, *data;
 
     if (!ht || !key)
         return NULL;
 
-    k = ht->hash(key, hash_arg) % ht->n_buckets;
-    res = htbucket_remove(ht->buckets + k, &data, key, ht->cmp, cmp_arg, free_key);
+    if (ht->cuckoo)
+    {
+        pos = ht_find_cuckoo(ht, key, hash_arg, cmp_arg);
+        if (pos == HTC_NONE)
+            return NULL;
+
+        htc_at(ht->cuckoo, pos, &k, &data);
+        FREE_KEY(k);
+        htc_remove_at(ht->cuckoo, pos, !(ht->options & HT_NOSHRINK));
+        ht->n_items--;
+        ht_filter_removed(ht, 1);
+        return data;
+    }
+
+    if (!(b = ht_find_bucket(ht, key, hash_arg)))
+        return NULL;
+
+    res = htbucket_remove(b, &data, key, ht->cmp, cmp_arg,
+            free_key, &ht->pool);
 
     if (res == HT_OK)
     {
         ht->n_items--;
+        ht_filter_removed(ht, 1);
         /* items < buckets/4 -> resize */
-        if (ht->n_items * 4 < ht->n_buckets)
+        if (!(ht->options & HT_NOSHRINK) && ht->n_items * 4 < ht->n_buckets)
             ht_resize(ht, 0);
         return data;
     }
@@ -621,11 +1101,80 @@ void *ht_remove_fa(hashtable *ht, const void *key,
     return NULL;
 }
 
+size_t ht_remove_all_a(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg)
+{
+    if (!ht || !key)
+        return 0;
+
+    return ht_remove_all_fa(ht, key, ht->free_key, ht->free_data,
+            hash_arg, cmp_arg);
+}
+
+size_t ht_remove_all_fa(hashtable *ht, const void *key,
+        void (*free_key)(void*), void (*free_data)(void*),
+        const void *hash_arg, const void *cmp_arg)
+{
+    htbucket *b;
+    size_t n, pos;
+    void *k, *data;
+
+    if (!ht || !key)
+        return 0;
+
+    if (ht->cuckoo)
+    {
+        pos = ht_find_cuckoo(ht, key, hash_arg, cmp_arg);
+        if (pos == HTC_NONE)
+            return 0;
+
+        htc_at(ht->cuckoo, pos, &k, &data);
+        FREE_KEY(k);
+        FREE_DATA(data);
+        htc_remove_at(ht->cuckoo, pos, !(ht->options & HT_NOSHRINK));
+        ht->n_items--;
+        ht_filter_removed(ht, 1);
+        return 1;
+    }
+
+    if (!(b = ht_find_bucket(ht, key, hash_arg)))
+        return 0;
+
+    n = htbucket_remove_all(b, key, ht->cmp, cmp_arg,
+            free_key, free_data, &ht->pool);
+
+    if (n)
+    {
+        ht->n_items -= n;
+        ht_filter_removed(ht, n);
+        if (!(ht->options & HT_NOSHRINK) && ht->n_items * 4 < ht->n_buckets)
+            ht_resize(ht, 0);
+    }
+
+    return n;
+}
+
 
 /*-------*/
 /* other */
 /*-------*/
 
+int ht_filter(hashtable *ht, double fp_rate)
+{
+    if (!ht)
+        return HT_ERROR;
+
+    if (fp_rate <= 0.0)
+    {
+        htf_free(ht->filter);
+        ht->filter = NULL;
+        return HT_OK;
+    }
+
+    ht->filter_fp_rate = fp_rate;
+    return ht_filter_rebuild(ht);
+}
+
 int ht_empty(hashtable *ht)
 {
     if (!ht)
@@ -644,10 +1193,20 @@ void *ht_pop(hashtable *ht, void **key, void **data)
     if (ht_empty(ht))
         return NULL;
 
+    if (ht->cuckoo)
+    {
+        i = 0;
+        htc_next(ht->cuckoo, &i, key, data);
+        htc_remove_at(ht->cuckoo, i-1, !(ht->options & HT_NOSHRINK));
+        ht->n_items--;
+        ht_filter_removed(ht, 1);
+        return *data;
+    }
+
     for (i = 0; i < ht->n_buckets; i++)
     {
         if (!htbucket_empty(ht->buckets + i))
-            return htbucket_pop(ht->buckets + i, key, data);
+            return htbucket_pop(ht->buckets + i, key, data, &ht->pool);
     }
     return NULL;
 }
@@ -667,6 +1226,8 @@ htiter *ht_iter(hashtable *ht)
         it->ht = ht;
         it->b = 0;
         it->cur = NULL;
+        it->key = NULL;
+        it->cmp_arg = NULL;
     }
     return it;
 }
@@ -675,6 +1236,52 @@ htiter *ht_iter(hashtable *ht)
 /* get next key/data pair */
 int htiter_next(htiter *it, void **key, void **data)
 {
+    void *k, *d;
+
+    if (it->ht->cuckoo)
+    {
+        /* it->b is the position of the next item */
+        if (it->key && it->b != HTC_NONE)
+        {
+            htc_at(it->ht->cuckoo, it->b, &k, &d);
+            it->b = HTC_NONE;
+        }
+        else if (it->key || !htc_next(it->ht->cuckoo, &it->b, &k, &d))
+        {
+            if (key) *key = NULL;
+            if (data) *data = NULL;
+            return 0;
+        }
+
+        if (key)
+            *key = k;
+        if (data)
+            *data = d;
+        return 1;
+    }
+
+    /* created by ht_get_all_a(): it->cur is the next item to return */
+    if (it->key)
+    {
+        if (!it->cur)
+        {
+            if (key) *key = NULL;
+            if (data) *data = NULL;
+            return 0;
+        }
+
+        if (key)
+            *key = it->cur->key;
+        if (data)
+            *data = it->cur->data;
+
+        /* equal keys are adjacent, so stop at the first different one */
+        it->cur = it->cur->next;
+        if (it->cur && it->ht->cmp(it->key, it->cur->key, it->cmp_arg) != 0)
+            it->cur = NULL;
+        return 1;
+    }
+
     /* still another item in current bucket */
     if (it->cur && it->cur->next)
         it->cur = it->cur->next;
@@ -62,6 +62,61 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define HT_ERROR -1
 #define HT_EXIST 1
 
+/*!
+ *  \def        HT_MULTI
+ *  \brief      option to ht_init_fo(): allow multiple pairs with equal key
+ *  \ingroup    def
+ *
+ *  \details
+ *      In multimap mode ht_insert_*() never returns HT_EXIST; pairs with
+ *      equal keys are chained next to each other in the same bucket.
+ *      ht_get_*(), ht_set_*() and ht_remove_*() operate on the first
+ *      pair stored for a key, use ht_get_all_a(), ht_count_a() and
+ *      ht_remove_all_fa() to access all of them.
+ */
+#define HT_MULTI 0x01
+
+/*!
+ *  \def        HT_NOSHRINK
+ *  \brief      option to ht_init_fo(): never shrink the bucket array
+ *  \ingroup    def
+ *
+ *  \details
+ *      Removing items will not resize the hashtable. Useful for tables
+ *      that are emptied and refilled repeatedly, see ht_clear().
+ */
+#define HT_NOSHRINK 0x02
+
+/*!
+ *  \def        HT_SMALL
+ *  \brief      option to ht_init_fo(): optimize for very few items
+ *  \ingroup    def
+ *
+ *  \details
+ *      The first few key/data pairs (HT_SMALL_ITEMS, 4 unless defined
+ *      otherwise when building the library) are stored inside the
+ *      hashtable object and searched linearly without hashing. Buckets
+ *      are only allocated when more pairs are inserted.
+ */
+#define HT_SMALL 0x04
+
+/*!
+ *  \def        HT_CUCKOO
+ *  \brief      option to ht_init_fo(): use cuckoo hashing
+ *  \ingroup    def
+ *
+ *  \details
+ *      Instead of chaining items in buckets, each key is stored in one
+ *      of two cache line sized buckets (5 slots with 64 bit pointers) or,
+ *      rarely, in a small stash, so a lookup reads at most two bucket
+ *      lines, the stash and, on a hit, one line holding the data pointer.
+ *      Items are moved to their alternative bucket to make room on insert.
+ *      Inserting fails with \ref HT_ERROR if too many keys (about 20)
+ *      have the same hash value.
+ *      Can't be combined with \ref HT_MULTI or \ref HT_SMALL.
+ */
+#define HT_CUCKOO 0x08
+
 
 /*==========*/
 /* typedefs */
@@ -159,6 +214,41 @@ int ht_init_f(hashtable **ht,
         ht_hashfunc_t hashfunc, ht_cmpfunc_t cmpfunc,
         void (*free_key)(void*), void (*free_data)(void*));
 
+/*! \brief      initialize a \ref hashtable object with options
+ *  \ingroup    mgmt
+ *
+ *  \details
+ *      Like ht_init(), with options (i.e. \ref HT_MULTI).
+ *
+ *  \param      ht          pointer to a hashtable* object to be initialized
+ *  \param      hashfunc    key hashing function
+ *  \param      cmpfunc     key comparison function
+ *  \param      options     bitwise OR of HT_* options
+ *
+ *  \return     status code
+ */
+#define ht_init_o(ht, hashfunc, cmpfunc, options) ht_init_fo(ht, hashfunc, cmpfunc, NULL, NULL, options)
+
+/*! \brief      initialize a hashtable object with options
+ *  \ingroup    mgmt
+ *
+ *  \details
+ *      Like ht_init_f(), with options (i.e. \ref HT_MULTI).
+ *
+ *  \param      ht          pointer to a hashtable* object to be initialized
+ *  \param      hashfunc    key hashing function
+ *  \param      cmpfunc     key comparison function
+ *  \param      free_key    function to free keys (or NULL)
+ *  \param      free_data   function to free data (or NULL)
+ *  \param      options     bitwise OR of HT_* options
+ *
+ *  \return     status code
+ */
+int ht_init_fo(hashtable **ht,
+        ht_hashfunc_t hashfunc, ht_cmpfunc_t cmpfunc,
+        void (*free_key)(void*), void (*free_data)(void*),
+        int options);
+
 /*! \brief      free a hashtable object
  *  \ingroup    mgmt
  *
@@ -186,6 +276,31 @@ void ht_free(hashtable *ht);
  */
 void ht_free_f(hashtable *ht, void (*free_key)(void*), void (*free_data)(void*));
 
+/*! \brief      Remove all key/data pairs
+ *  \ingroup    mgmt
+ *
+ *  \details
+ *      Removes all key/data pairs using the freeing functions specified
+ *      to ht_init_f() earlier. The bucket array and the memory used for
+ *      the pairs are kept, so refilling the table does not allocate
+ *      until it grows beyond its previous size.
+ *
+ *  \param      ht          hashtable* object
+ */
+void ht_clear(hashtable *ht);
+
+/*! \brief      Remove all key/data pairs with custom freeing funcs
+ *  \ingroup    mgmt
+ *
+ *  \details
+ *      Like ht_clear(), using the freeing functions passed as arguments.
+ *
+ *  \param      ht          hashtable* object
+ *  \param      free_key    function to free keys (or NULL)
+ *  \param      free_data   function to free data (or NULL)
+ */
+void ht_clear_f(hashtable *ht, void (*free_key)(void*), void (*free_data)(void*));
+
 /*! \brief      Determine if hash table is empty
  *  \ingroup    mgmt
  *
@@ -350,6 +465,63 @@ int ht_set_fa(hashtable *ht, void *key, void *data,
 void *ht_get_a(hashtable *ht, const void *key,
         const void *hash_arg, const void *cmp_arg);
 
+/*! \brief      Retrieve all data stored for a key
+ *  \ingroup    dataop
+ *
+ *  \details
+ *      Returns an iterator over all key/data pairs with the given key,
+ *      see ht_get_all_a().
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *
+ *  \return     iterator instance or NULL
+ */
+#define ht_get_all(ht, key) ht_get_all_a(ht, key, NULL, NULL)
+
+/*! \brief      Retrieve all data stored for a key with additional arguments
+ *  \ingroup    dataop
+ *
+ *  \details
+ *      Returns an iterator over all key/data pairs with the given key
+ *      (mostly useful with \ref HT_MULTI). Use htiter_next() to retrieve
+ *      the pairs in insertion order. The iterator must not be used after
+ *      the hashtable was modified and should be free'd by using free().
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key (must stay valid while iterating)
+ *  \param      hash_arg    second argument to hash function
+ *  \param      cmp_arg     third argument to compare function (must stay
+ *                          valid while iterating)
+ *
+ *  \return     iterator instance or NULL
+ */
+htiter *ht_get_all_a(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg);
+
+/*! \brief      Count pairs with equal key
+ *  \ingroup    dataop
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *
+ *  \return     number of key/data pairs with equal key
+ */
+#define ht_count(ht, key) ht_count_a(ht, key, NULL, NULL)
+
+/*! \brief      Count pairs with equal key with additional arguments
+ *  \ingroup    dataop
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *  \param      hash_arg    second argument to hash function
+ *  \param      cmp_arg     third argument to compare function
+ *
+ *  \return     number of key/data pairs with equal key
+ */
+size_t ht_count_a(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg);
+
 /*--------*/
 /* remove */
 /*--------*/
@@ -416,6 +588,82 @@ void *ht_remove_fa(hashtable *ht, const void *key,
         void (*free_key)(void*),
         const void *hash_arg, const void *cmp_arg);
 
+/*! \brief      Remove all pairs with equal key
+ *  \ingroup    dataop
+ *
+ *  \details
+ *      Removes all key/data pairs with the given key, freeing keys
+ *      and data using ht's freeing functions.
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *
+ *  \return     number of removed pairs
+ */
+#define ht_remove_all(ht, key) ht_remove_all_a(ht, key, NULL, NULL)
+
+/*! \brief      Remove all pairs with equal key with additional arguments
+ *  \ingroup    dataop
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *  \param      hash_arg    second argument to hash function
+ *  \param      cmp_arg     third argument to compare function
+ *
+ *  \return     number of removed pairs
+ */
+size_t ht_remove_all_a(hashtable *ht, const void *key,
+        const void *hash_arg, const void *cmp_arg);
+
+/*! \brief      Remove all pairs with equal key with custom freeing funcs
+ *  \ingroup    dataop
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *  \param      free_key    function to free keys (or NULL)
+ *  \param      free_data   function to free data (or NULL)
+ *
+ *  \return     number of removed pairs
+ */
+#define ht_remove_all_f(ht, key, free_key, free_data) ht_remove_all_fa(ht, key, free_key, free_data, NULL, NULL)
+
+/*! \brief      Remove all pairs with equal key with custom freeing funcs and additional arguments
+ *  \ingroup    dataop
+ *
+ *  \param      ht          hashtable* object
+ *  \param      key         key
+ *  \param      free_key    function to free keys (or NULL)
+ *  \param      free_data   function to free data (or NULL)
+ *  \param      hash_arg    second argument to hash function
+ *  \param      cmp_arg     third argument to compare function
+ *
+ *  \return     number of removed pairs
+ */
+size_t ht_remove_all_fa(hashtable *ht, const void *key,
+        void (*free_key)(void*), void (*free_data)(void*),
+        const void *hash_arg, const void *cmp_arg);
+
+/*! \brief      Use an approximate membership filter for lookups
+ *  \ingroup    dataop
+ *
+ *  \details
+ *      Builds a blocked bloom filter (see htfilter.h) from the hashes of
+ *      all keys and keeps it up to date on insert. Lookups and removals
+ *      of keys rejected by the filter return without touching the
+ *      buckets, which makes misses cheap. Since removed keys can't be
+ *      deleted from the filter, it is rebuilt after many removals or
+ *      when the table outgrows it; like resizing, rebuilding hashes the
+ *      keys without hash_arg.
+ *
+ *  \param      ht          hashtable* object
+ *  \param      fp_rate     false positive rate of the filter, 0 to
+ *                          remove the filter
+ *
+ *  \return     HT_OK on success,
+ *              HT_ERROR if an error occured.
+ */
+int ht_filter(hashtable *ht, double fp_rate);
+
 /*! \brief      Pop first item from first non-empty bucket
  *  \ingroup    dataop
  *
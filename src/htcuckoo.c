@@ -0,0 +1,595 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "htcuckoo.h"
+
+#include <stdlib.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+#define FREE_KEY(p) if (free_key) free_key(p)
+#define FREE_DATA(p) if (free_data) free_data(p)
+
+/* buckets are aligned to cache lines, so a bucket is never split */
+#define HTC_LINE 64
+
+/* slots per bucket: as many hash/key pairs as fit into a cache line, i.e.
+ * 5 with 64 bit pointers and 8 with 32 bit pointers */
+#define HTC_SLOTS ((int)(HTC_LINE / (sizeof(hash_t) + sizeof(void*))))
+
+/* items that didn't fit into their buckets */
+#define HTC_STASH 8
+
+/* initial number of buckets, must be a power of two */
+#define HTC_MIN_BUCKETS 16
+
+/* maximum number of buckets visited when searching an eviction path */
+#define HTC_BFS_MAX 128
+
+/* maximum number of times a single insert may double the table */
+#define HTC_MAX_GROW 4
+
+#define N_BUCKETS(c) ((c)->buckets ? (c)->mask + 1 : 0)
+
+/*=========*/
+/* structs */
+/*=========*/
+
+/* empty slots have key == NULL; hashes are stored so that items can be
+ * compared and moved without calling the hash/cmp functions. data pointers
+ * live in a parallel array (slot b * HTC_SLOTS + s) that is only read on a
+ * hit, so a lookup touches at most two bucket lines, one data line and the
+ * stash */
+struct htcbucket
+{
+    hash_t hash[HTC_SLOTS];
+    void *key[HTC_SLOTS];
+};
+
+/* fails to compile if a bucket doesn't fit into a cache line */
+typedef char htc_bucket_fits[(sizeof(struct htcbucket) <= HTC_LINE) ? 1 : -1];
+
+struct htcuckoo
+{
+    size_t n_items;
+    size_t mask;
+    struct htcbucket *buckets;
+    void **data;
+
+    /* allocation containing buckets and data */
+    void *mem;
+
+    size_t n_stash;
+    hash_t stash_hash[HTC_STASH];
+    void *stash_key[HTC_STASH];
+    void *stash_data[HTC_STASH];
+};
+
+/* node of the eviction search: bucket was reached by moving the item in
+ * slot of the parent node's bucket */
+struct htcpath
+{
+    size_t bucket;
+    int parent;
+    int slot;
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* alternative bucket for an item with the given hash in bucket b */
+static size_t htc_alt(size_t b, hash_t hash, size_t mask);
+
+/* return index of an empty slot in b or -1 */
+static int htc_empty_slot(struct htcbucket *b);
+
+/* store item in an empty slot of bucket b, return non-zero on success */
+static int htc_put(htcuckoo *c, size_t b, hash_t hash, void *key, void *data);
+
+/* move item from one slot to another */
+static void htc_move(htcuckoo *c, size_t from, int fslot, size_t to, int tslot);
+
+/* make room in b1 or b2 by moving items to their alternative buckets */
+static int htc_evict(htcuckoo *c, size_t b1, size_t b2,
+        hash_t hash, void *key, void *data);
+
+/* insert an item known not to be present, returns HT_ERROR if it didn't fit */
+static int htc_place(htcuckoo *c, hash_t hash, void *key, void *data);
+
+/* number of items with the given hash in its buckets and the stash */
+static size_t htc_count_hash(htcuckoo *c, hash_t hash);
+
+/* insert all items of src into dst */
+static int htc_fill(htcuckoo *dst, htcuckoo *src);
+
+/* move all items into n_buckets new buckets, returns HT_ERROR (leaving c
+ * unchanged) if they don't fit */
+static int htc_rehash(htcuckoo *c, size_t n_buckets);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static size_t htc_alt(size_t b, hash_t hash, size_t mask)
+{
+    /* XOR keeps htc_alt(htc_alt(b)) == b */
+    unsigned long x = (unsigned long)(hash >> 12 | 1) * 0x5bd1e995UL;
+    x ^= x >> 15;
+    return (b ^ (size_t)x) & mask;
+}
+
+static int htc_empty_slot(struct htcbucket *b)
+{
+    int s;
+
+    for (s = 0; s < HTC_SLOTS; s++)
+    {
+        if (!b->key[s])
+            return s;
+    }
+    return -1;
+}
+
+static int htc_put(htcuckoo *c, size_t b, hash_t hash, void *key, void *data)
+{
+    int s = htc_empty_slot(c->buckets + b);
+
+    if (s < 0)
+        return 0;
+
+    c->buckets[b].hash[s] = hash;
+    c->buckets[b].key[s] = key;
+    c->data[b * HTC_SLOTS + s] = data;
+    return 1;
+}
+
+static void htc_move(htcuckoo *c, size_t from, int fslot, size_t to, int tslot)
+{
+    c->buckets[to].hash[tslot] = c->buckets[from].hash[fslot];
+    c->buckets[to].key[tslot] = c->buckets[from].key[fslot];
+    c->data[to * HTC_SLOTS + tslot] = c->data[from * HTC_SLOTS + fslot];
+    c->buckets[from].key[fslot] = NULL;
+}
+
+static int htc_evict(htcuckoo *c, size_t b1, size_t b2,
+        hash_t hash, void *key, void *data)
+{
+    struct htcpath q[HTC_BFS_MAX];
+    struct htcbucket *b;
+    size_t alt;
+    int head, tail, i, s, e, j;
+
+    q[0].bucket = b1;
+    q[0].parent = -1;
+    q[0].slot = -1;
+    tail = 1;
+    if (b2 != b1)
+    {
+        q[1].bucket = b2;
+        q[1].parent = -1;
+        q[1].slot = -1;
+        tail = 2;
+    }
+
+    /* breadth first search for a bucket with an empty slot */
+    for (head = 0; head < tail; head++)
+    {
+        b = c->buckets + q[head].bucket;
+
+        for (s = 0; s < HTC_SLOTS; s++)
+        {
+            alt = htc_alt(q[head].bucket, b->hash[s], c->mask);
+            if (alt == q[head].bucket)
+                continue;
+
+            e = htc_empty_slot(c->buckets + alt);
+            if (e < 0)
+            {
+                /* don't visit a bucket twice on the same path */
+                for (i = head; i >= 0 && q[i].bucket != alt; i = q[i].parent)
+                    ;
+                if (i < 0 && tail < HTC_BFS_MAX)
+                {
+                    q[tail].bucket = alt;
+                    q[tail].parent = head;
+                    q[tail].slot = s;
+                    tail++;
+                }
+                continue;
+            }
+
+            /* found: move items along the path, starting at its end */
+            htc_move(c, q[head].bucket, s, alt, e);
+            for (i = head; q[i].parent >= 0; i = j)
+            {
+                j = q[i].parent;
+                htc_move(c, q[j].bucket, q[i].slot, q[i].bucket, s);
+                s = q[i].slot;
+            }
+
+            b = c->buckets + q[i].bucket;
+            b->hash[s] = hash;
+            b->key[s] = key;
+            c->data[q[i].bucket * HTC_SLOTS + s] = data;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int htc_place(htcuckoo *c, hash_t hash, void *key, void *data)
+{
+    size_t b1, b2;
+
+    b1 = hash & c->mask;
+    b2 = htc_alt(b1, hash, c->mask);
+
+    if (htc_put(c, b1, hash, key, data) ||
+        htc_put(c, b2, hash, key, data) ||
+        htc_evict(c, b1, b2, hash, key, data))
+        return HT_OK;
+
+    if (c->n_stash < HTC_STASH)
+    {
+        c->stash_hash[c->n_stash] = hash;
+        c->stash_key[c->n_stash] = key;
+        c->stash_data[c->n_stash] = data;
+        c->n_stash++;
+        return HT_OK;
+    }
+
+    return HT_ERROR;
+}
+
+static size_t htc_count_hash(htcuckoo *c, hash_t hash)
+{
+    size_t b[2], n = 0, i;
+    int s;
+
+    b[0] = hash & c->mask;
+    b[1] = htc_alt(b[0], hash, c->mask);
+
+    for (i = 0; i < 2 && (i == 0 || b[1] != b[0]); i++)
+    {
+        for (s = 0; s < HTC_SLOTS; s++)
+        {
+            if (c->buckets[b[i]].key[s] && c->buckets[b[i]].hash[s] == hash)
+                n++;
+        }
+    }
+
+    for (i = 0; i < c->n_stash; i++)
+    {
+        if (c->stash_hash[i] == hash)
+            n++;
+    }
+    return n;
+}
+
+static int htc_fill(htcuckoo *dst, htcuckoo *src)
+{
+    struct htcbucket *b;
+    size_t i;
+    int s;
+
+    for (i = 0; i < N_BUCKETS(src); i++)
+    {
+        b = src->buckets + i;
+        for (s = 0; s < HTC_SLOTS; s++)
+        {
+            if (b->key[s] && htc_place(dst, b->hash[s], b->key[s],
+                        src->data[i * HTC_SLOTS + s]) != HT_OK)
+                return HT_ERROR;
+        }
+    }
+
+    for (i = 0; i < src->n_stash; i++)
+    {
+        if (htc_place(dst, src->stash_hash[i], src->stash_key[i],
+                    src->stash_data[i]) != HT_OK)
+            return HT_ERROR;
+    }
+
+    return HT_OK;
+}
+
+static int htc_rehash(htcuckoo *c, size_t n_buckets)
+{
+    htcuckoo tmp;
+    size_t i;
+    int s;
+
+    tmp.n_items = c->n_items;
+    tmp.mask = n_buckets - 1;
+    tmp.n_stash = 0;
+    tmp.mem = malloc(n_buckets * (sizeof *tmp.buckets +
+                HTC_SLOTS * sizeof *tmp.data) + HTC_LINE);
+    if (!tmp.mem)
+        return HT_ERROR;
+
+    tmp.buckets = (struct htcbucket*)((char*)tmp.mem +
+            (HTC_LINE - (unsigned long)tmp.mem % HTC_LINE) % HTC_LINE);
+    tmp.data = (void**)(tmp.buckets + n_buckets);
+
+    for (i = 0; i < n_buckets; i++)
+    {
+        for (s = 0; s < HTC_SLOTS; s++)
+            tmp.buckets[i].key[s] = NULL;
+    }
+
+    if (htc_fill(&tmp, c) != HT_OK)
+    {
+        free(tmp.mem);
+        return HT_ERROR;
+    }
+
+    free(c->mem);
+    *c = tmp;
+    return HT_OK;
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+/*============*/
+/* management */
+/*============*/
+
+htcuckoo *htc_init(void)
+{
+    htcuckoo *c = malloc(sizeof *c);
+
+    if (c)
+    {
+        c->n_items = 0;
+        c->mask = 0;
+        c->buckets = NULL;
+        c->data = NULL;
+        c->mem = NULL;
+        c->n_stash = 0;
+    }
+    return c;
+}
+
+void htc_clear(htcuckoo *c, void (*free_key)(void*), void (*free_data)(void*))
+{
+    size_t i;
+    int s;
+
+    for (i = 0; i < N_BUCKETS(c); i++)
+    {
+        for (s = 0; s < HTC_SLOTS; s++)
+        {
+            if (c->buckets[i].key[s])
+            {
+                FREE_KEY(c->buckets[i].key[s]);
+                FREE_DATA(c->data[i * HTC_SLOTS + s]);
+                c->buckets[i].key[s] = NULL;
+            }
+        }
+    }
+
+    for (i = 0; i < c->n_stash; i++)
+    {
+        FREE_KEY(c->stash_key[i]);
+        FREE_DATA(c->stash_data[i]);
+    }
+
+    c->n_stash = 0;
+    c->n_items = 0;
+}
+
+void htc_free(htcuckoo *c, void (*free_key)(void*), void (*free_data)(void*))
+{
+    if (!c)
+        return;
+
+    htc_clear(c, free_key, free_data);
+    free(c->mem);
+    free(c);
+}
+
+size_t htc_n_buckets(htcuckoo *c)
+{
+    return N_BUCKETS(c);
+}
+
+size_t htc_bucket_items(htcuckoo *c, size_t i)
+{
+    size_t n = 0;
+    int s;
+
+    for (s = 0; s < HTC_SLOTS; s++)
+    {
+        if (c->buckets[i].key[s])
+            n++;
+    }
+    return n;
+}
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+int htc_insert(htcuckoo *c, hash_t hash, void *key, void *data,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg)
+{
+    size_t n;
+    int grown = 0;
+
+    if (htc_find(c, hash, key, cmp, cmp_arg) != HTC_NONE)
+        return HT_EXIST;
+
+    if (!c->buckets && htc_rehash(c, HTC_MIN_BUCKETS) != HT_OK)
+        return HT_ERROR;
+
+    /* the stash is full, too */
+    n = N_BUCKETS(c);
+    while (htc_place(c, hash, key, data) != HT_OK)
+    {
+        /* items with equal hash share their buckets in any table size, so
+         * growing can't make room if they fill both buckets and the stash */
+        if (htc_count_hash(c, hash) >= 2 * HTC_SLOTS + HTC_STASH)
+            return HT_ERROR;
+
+        do
+        {
+            if (grown++ == HTC_MAX_GROW)
+                return HT_ERROR;
+            n *= 2;
+        }
+        while (htc_rehash(c, n) != HT_OK);
+    }
+
+    c->n_items++;
+    return HT_OK;
+}
+
+size_t htc_find(htcuckoo *c, hash_t hash, const void *key,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg)
+{
+    struct htcbucket *p;
+    size_t b1, b2, i;
+    int s;
+
+    if (!c->buckets)
+        return HTC_NONE;
+
+    /* at most two buckets are searched... */
+    b1 = hash & c->mask;
+    p = c->buckets + b1;
+    for (s = 0; s < HTC_SLOTS; s++)
+    {
+        if (p->key[s] && p->hash[s] == hash && cmp(key, p->key[s], cmp_arg) == 0)
+            return b1 * HTC_SLOTS + s;
+    }
+
+    b2 = htc_alt(b1, hash, c->mask);
+    p = c->buckets + b2;
+    for (s = 0; s < HTC_SLOTS; s++)
+    {
+        if (p->key[s] && p->hash[s] == hash && cmp(key, p->key[s], cmp_arg) == 0)
+            return b2 * HTC_SLOTS + s;
+    }
+
+    /* ...plus the (usually empty) stash */
+    for (i = 0; i < c->n_stash; i++)
+    {
+        if (c->stash_hash[i] == hash && cmp(key, c->stash_key[i], cmp_arg) == 0)
+            return N_BUCKETS(c) * HTC_SLOTS + i;
+    }
+
+    return HTC_NONE;
+}
+
+void htc_at(htcuckoo *c, size_t pos, void **key, void **data)
+{
+    size_t n = N_BUCKETS(c) * HTC_SLOTS;
+
+    if (pos < n)
+    {
+        *key = c->buckets[pos / HTC_SLOTS].key[pos % HTC_SLOTS];
+        *data = c->data[pos];
+    }
+    else
+    {
+        *key = c->stash_key[pos - n];
+        *data = c->stash_data[pos - n];
+    }
+}
+
+void htc_remove_at(htcuckoo *c, size_t pos, int shrink)
+{
+    size_t n = N_BUCKETS(c) * HTC_SLOTS;
+    size_t b1, b2, i;
+
+    if (pos < n)
+    {
+        c->buckets[pos / HTC_SLOTS].key[pos % HTC_SLOTS] = NULL;
+
+        /* move stashed items back into the table if possible */
+        for (i = c->n_stash; i--; )
+        {
+            b1 = c->stash_hash[i] & c->mask;
+            b2 = htc_alt(b1, c->stash_hash[i], c->mask);
+            if (htc_put(c, b1, c->stash_hash[i], c->stash_key[i], c->stash_data[i]) ||
+                htc_put(c, b2, c->stash_hash[i], c->stash_key[i], c->stash_data[i]))
+            {
+                c->n_stash--;
+                c->stash_hash[i] = c->stash_hash[c->n_stash];
+                c->stash_key[i] = c->stash_key[c->n_stash];
+                c->stash_data[i] = c->stash_data[c->n_stash];
+            }
+        }
+    }
+    else
+    {
+        i = pos - n;
+        c->n_stash--;
+        c->stash_hash[i] = c->stash_hash[c->n_stash];
+        c->stash_key[i] = c->stash_key[c->n_stash];
+        c->stash_data[i] = c->stash_data[c->n_stash];
+    }
+
+    c->n_items--;
+
+    /* less than 1/8 of all slots used -> try to halve the table */
+    if (shrink && N_BUCKETS(c) > HTC_MIN_BUCKETS && c->n_items * 8 < n)
+        htc_rehash(c, N_BUCKETS(c) / 2);
+}
+
+int htc_next(htcuckoo *c, size_t *pos, void **key, void **data)
+{
+    size_t n = N_BUCKETS(c) * HTC_SLOTS;
+
+    for (; *pos < n; (*pos)++)
+    {
+        if (c->buckets[*pos / HTC_SLOTS].key[*pos % HTC_SLOTS])
+        {
+            htc_at(c, (*pos)++, key, data);
+            return 1;
+        }
+    }
+
+    if (*pos < n + c->n_stash)
+    {
+        htc_at(c, (*pos)++, key, data);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HTCUCKOO_H
+#define HTCUCKOO_H
+
+/* bucketized cuckoo hashing backend of hashtable (see HT_CUCKOO); keys are
+ * hashed by the caller, so all functions take the key's hash value */
+
+#include "hashtable.h"
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* returned by htc_find() if the key is not present */
+#define HTC_NONE ((size_t)-1)
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct htcuckoo htcuckoo;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* initialize cuckoo table; buckets are allocated on first insert */
+htcuckoo *htc_init(void);
+
+/* remove all items, using the passed free_*() functions on key and data;
+ * keeps the allocated buckets */
+void htc_clear(htcuckoo *c, void (*free_key)(void*), void (*free_data)(void*));
+
+/* clear and free a cuckoo table */
+void htc_free(htcuckoo *c, void (*free_key)(void*), void (*free_data)(void*));
+
+/* number of buckets and number of items in bucket i (for ht_statistics()) */
+size_t htc_n_buckets(htcuckoo *c);
+size_t htc_bucket_items(htcuckoo *c, size_t i);
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* insert item, returns HT_OK, HT_EXIST or HT_ERROR; the latter also if
+ * the key's hash is shared by the items of both its buckets and the
+ * stash, or if the table would have to grow more than 16-fold */
+int htc_insert(htcuckoo *c, hash_t hash, void *key, void *data,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg);
+
+/* return position of item with equal key or HTC_NONE */
+size_t htc_find(htcuckoo *c, hash_t hash, const void *key,
+        int (*cmp)(const void*, const void*, const void*), const void *cmp_arg);
+
+/* store key and data of the item at position pos in the passed pointers */
+void htc_at(htcuckoo *c, size_t pos, void **key, void **data);
+
+/* remove item at position pos; shrink the table if it's mostly empty and
+ * shrink is non-zero */
+void htc_remove_at(htcuckoo *c, size_t pos, int shrink);
+
+/* find first item at a position >= *pos, store it in key/data and set *pos
+ * to the following position; returns zero if there are no more items */
+int htc_next(htcuckoo *c, size_t *pos, void **key, void **data);
+
+#endif
@@ -0,0 +1,224 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "htfilter.h"
+
+#include <stdlib.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* a block has one 32 bit word per bit set for a hash (256 bits = one AVX2
+ * register or half a cache line), so each lookup touches a single block */
+#define HTF_WORDS 8
+#define HTF_BLOCK_BITS (HTF_WORDS * 32)
+
+#define MASK32 0xFFFFFFFFUL
+
+/*=========*/
+/* structs */
+/*=========*/
+
+struct htfilter
+{
+    size_t capacity;
+    size_t n_blocks;
+    unsigned int *blocks;
+};
+
+/* odd multipliers choosing the bit in each word (from parquet's bloom filter) */
+static const unsigned long salt[HTF_WORDS] =
+{
+    0x47b6137bUL, 0x44974d91UL, 0x8824ad5bUL, 0xa2b7289dUL,
+    0x705495c7UL, 0x2df1424bUL, 0x9efc4947UL, 0x5c6bfb31UL
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* e^x, avoids depending on libm */
+static double htf_exp(double x);
+
+/* false positive rate with on average lambda hashes per block */
+static double htf_fp_rate(double lambda);
+
+/* index of the block for hash */
+static size_t htf_block(htfilter *f, hash_t hash);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static double htf_exp(double x)
+{
+    double sum = 1.0, term = 1.0;
+    int i, sq = 0;
+
+    if (x < 0)
+        return 1.0 / htf_exp(-x);
+
+    /* e^x = (e^(x/2^sq))^(2^sq) with x/2^sq < 1 */
+    while (x >= 1.0)
+    {
+        x /= 2;
+        sq++;
+    }
+
+    for (i = 1; i < 20; i++)
+    {
+        term *= x / i;
+        sum += term;
+    }
+
+    while (sq--)
+        sum *= sum;
+
+    return sum;
+}
+
+static double htf_fp_rate(double lambda)
+{
+    double p_block, p_bits, fp = 0.0, one_minus;
+    int i, j;
+
+    /* the number of hashes in a block is poisson distributed; with i
+     * hashes, a bit of a word is set with probability 1-(31/32)^i */
+    p_block = htf_exp(-lambda);
+    one_minus = 1.0;
+    for (i = 0; i < 10 * lambda + 100; i++)
+    {
+        p_bits = 1.0;
+        for (j = 0; j < HTF_WORDS; j++)
+            p_bits *= 1.0 - one_minus;
+
+        fp += p_block * p_bits;
+        p_block *= lambda / (i + 1);
+        one_minus *= 31.0 / 32.0;
+    }
+    return fp;
+}
+
+static size_t htf_block(htfilter *f, hash_t hash)
+{
+    /* the bits within the block are chosen by the high bits of
+     * hash * salt[], so use a different mix for the block index */
+    unsigned long h = ((unsigned long)hash * 0x9e3779b1UL) & MASK32;
+    return (size_t)((h ^ (h >> 16)) % f->n_blocks);
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+/*============*/
+/* management */
+/*============*/
+
+htfilter *htf_init(size_t n_items, double fp_rate)
+{
+    htfilter *f;
+    double bits = 4.0;
+
+    if (n_items == 0)
+        n_items = 1;
+
+    /* find the lowest number of bits per hash giving the requested rate */
+    while (bits < 64.0 && htf_fp_rate(HTF_BLOCK_BITS / bits) > fp_rate)
+        bits += 0.5;
+
+    f = malloc(sizeof *f);
+    if (!f)
+        return NULL;
+
+    f->capacity = n_items;
+    f->n_blocks = (size_t)(n_items * bits / HTF_BLOCK_BITS) + 1;
+    f->blocks = calloc(f->n_blocks * HTF_WORDS, sizeof *f->blocks);
+
+    if (!f->blocks)
+    {
+        free(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+void htf_clear(htfilter *f)
+{
+    size_t i;
+
+    for (i = 0; i < f->n_blocks * HTF_WORDS; i++)
+        f->blocks[i] = 0;
+}
+
+void htf_free(htfilter *f)
+{
+    if (!f)
+        return;
+
+    free(f->blocks);
+    free(f);
+}
+
+size_t htf_capacity(htfilter *f)
+{
+    return f->capacity;
+}
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+void htf_add(htfilter *f, hash_t hash)
+{
+    unsigned int *b = f->blocks + htf_block(f, hash) * HTF_WORDS;
+    int i;
+
+    for (i = 0; i < HTF_WORDS; i++)
+        b[i] |= 1U << ((((unsigned long)hash * salt[i]) & MASK32) >> 27);
+}
+
+int htf_contains(htfilter *f, hash_t hash)
+{
+    unsigned int *b = f->blocks + htf_block(f, hash) * HTF_WORDS;
+    unsigned int miss = 0;
+    int i;
+
+    /* no early exit, so the loop can be vectorized */
+    for (i = 0; i < HTF_WORDS; i++)
+        miss |= ~b[i] & (1U << ((((unsigned long)hash * salt[i]) & MASK32) >> 27));
+
+    return !miss;
+}
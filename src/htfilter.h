@@ -0,0 +1,76 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HTFILTER_H
+#define HTFILTER_H
+
+/* approximate membership filter (split block bloom filter) on hash_t values,
+ * i.e. as returned by the hash function of a hashtable; see also ht_filter() */
+
+#include "hashtable.h"
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct htfilter htfilter;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* initialize a filter for up to n_items hashes with a false positive
+ * rate of (roughly) at most fp_rate */
+htfilter *htf_init(size_t n_items, double fp_rate);
+
+/* remove all hashes from the filter */
+void htf_clear(htfilter *f);
+
+/* free a filter */
+void htf_free(htfilter *f);
+
+/* number of hashes the filter was initialized for */
+size_t htf_capacity(htfilter *f);
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* add a hash to the filter */
+void htf_add(htfilter *f, hash_t hash);
+
+/* returns zero if hash was definitely not added, non-zero if it might have been */
+int htf_contains(htfilter *f, hash_t hash);
+
+#endif
@@ -0,0 +1,1174 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "intset.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* a container holds the keys with equal upper bits */
+#define IS_LOW_BITS 16
+#define IS_LOW_MASK 0xffffUL
+
+/* arrays hold at most this many keys, larger containers become bitmaps */
+#define IS_ARRAY_MAX 4096
+
+/* words of a bitmap */
+#define IS_WORDS (65536 / 64)
+#define IS_BITMAP_BYTES (IS_WORDS * sizeof(uint64_t))
+
+/* flipping the sign bit makes unsigned order match signed order */
+#define IS_SIGN ((unsigned long)LONG_MAX + 1)
+
+#define ARRAY(c) ((uint16_t*)(c)->mem)
+#define BITS(c) ((uint64_t*)(c)->mem)
+#define RUNS(c) ((struct isrun*)(c)->mem)
+
+#define IS_BIT(bits, v) ((bits)[(v) / 64] >> ((v) % 64) & 1)
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+enum iscont_type { IS_ARRAY, IS_BITMAP, IS_RUN };
+
+/* keys start..last */
+struct isrun
+{
+    uint16_t start, last;
+};
+
+struct iscont
+{
+    /* upper bits of the keys */
+    unsigned long high;
+    enum iscont_type type;
+    /* number of keys */
+    size_t n;
+    /* used and allocated array entries or runs */
+    size_t len, cap;
+    void *mem;
+};
+
+struct intset
+{
+    /* sorted by high */
+    struct iscont *conts;
+    size_t len, cap;
+    size_t n;
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* number of set bits / trailing zero bits (x != 0) */
+static int is_popcount(uint64_t x);
+static int is_ctz(uint64_t x);
+
+/* split key into container and position in it, and back */
+static void is_split(long key, unsigned long *high, unsigned int *low);
+static long is_join(unsigned long high, unsigned int low);
+
+/* position of the container for high in s, or where it would be inserted;
+ * returns non-zero if it exists */
+static int is_find(intset *s, unsigned long high, size_t *pos);
+
+/* number of entries < v / runs starting at or before v */
+static size_t is_bisect(const uint16_t *a, size_t n, unsigned int v);
+static size_t is_run_find(const struct isrun *r, size_t n, unsigned int v);
+
+/* make room for one more array entry or run */
+static int is_reserve(struct iscont *c, size_t size);
+
+/* set bits from..to */
+static void is_set_range(uint64_t *bits, unsigned int from, unsigned int to);
+
+/* or the keys of c into bits */
+static void is_to_bitmap(struct iscont *c, uint64_t *bits);
+
+/* store the keys / runs of bits in out (if not NULL), returns their
+ * number */
+static size_t is_bits_array(const uint64_t *bits, uint16_t *out);
+static size_t is_bits_runs(const uint64_t *bits, struct isrun *out);
+
+/* change the representation of c; on error, c stays as it is */
+static int is_convert(struct iscont *c, enum iscont_type type);
+
+/* convert c to array or bitmap if it's stored wastefully */
+static void is_fix(struct iscont *c);
+
+/* operations on one container; insert and remove return 0 if the
+ * container was changed, 1 if not and -1 on error */
+static int is_cont_contains(struct iscont *c, unsigned int low);
+static int is_cont_insert(struct iscont *c, unsigned int low);
+static int is_cont_remove(struct iscont *c, unsigned int low);
+static size_t is_cont_rank(struct iscont *c, unsigned int low);
+static size_t is_cont_range(struct iscont *c, unsigned int lo,
+        unsigned int hi, void (*callback)(long, void*), void *arg);
+
+/* copy src to dst / set dst to the keys in bits */
+static int is_cont_copy(struct iscont *dst, struct iscont *src);
+static int is_cont_bits(struct iscont *dst, uint64_t *bits);
+
+/* union / intersection of a and b in dst (with dst->n == 0 if empty) */
+static int is_cont_union(struct iscont *dst, struct iscont *a,
+        struct iscont *b);
+static int is_cont_intersect(struct iscont *dst, struct iscont *a,
+        struct iscont *b);
+
+/* append c (which is then owned by s) */
+static int is_append(intset *s, struct iscont *c);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static int is_popcount(uint64_t x)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    int n;
+    for (n = 0; x; n++)
+        x &= x - 1;
+    return n;
+#endif
+}
+
+static int is_ctz(uint64_t x)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int n;
+    for (n = 0; !(x & 1); n++)
+        x >>= 1;
+    return n;
+#endif
+}
+
+static void is_split(long key, unsigned long *high, unsigned int *low)
+{
+    unsigned long u = (unsigned long)key ^ IS_SIGN;
+
+    *high = u >> IS_LOW_BITS;
+    *low = u & IS_LOW_MASK;
+}
+
+static long is_join(unsigned long high, unsigned int low)
+{
+    unsigned long u = (high << IS_LOW_BITS | low) ^ IS_SIGN;
+
+    /* converting to long without relying on the representation */
+    if (u <= LONG_MAX)
+        return u;
+    return -(long)(ULONG_MAX - u) - 1;
+}
+
+static int is_find(intset *s, unsigned long high, size_t *pos)
+{
+    size_t lo = 0, n = s->len, mid;
+
+    while (n)
+    {
+        mid = lo + n / 2;
+        if (s->conts[mid].high < high)
+        {
+            lo = mid + 1;
+            n -= n / 2 + 1;
+        }
+        else
+            n /= 2;
+    }
+    *pos = lo;
+    return (lo < s->len && s->conts[lo].high == high);
+}
+
+static size_t is_bisect(const uint16_t *a, size_t n, unsigned int v)
+{
+    size_t lo = 0, mid;
+
+    while (n)
+    {
+        mid = lo + n / 2;
+        if (a[mid] < v)
+        {
+            lo = mid + 1;
+            n -= n / 2 + 1;
+        }
+        else
+            n /= 2;
+    }
+    return lo;
+}
+
+static size_t is_run_find(const struct isrun *r, size_t n, unsigned int v)
+{
+    size_t lo = 0, mid;
+
+    while (n)
+    {
+        mid = lo + n / 2;
+        if (r[mid].start <= v)
+        {
+            lo = mid + 1;
+            n -= n / 2 + 1;
+        }
+        else
+            n /= 2;
+    }
+    return lo;
+}
+
+static int is_reserve(struct iscont *c, size_t size)
+{
+    size_t cap;
+    void *mem;
+
+    if (c->len < c->cap)
+        return 0;
+
+    cap = (c->cap) ? 2 * c->cap : 4;
+    if (!(mem = realloc(c->mem, cap * size)))
+        return -1;
+
+    c->mem = mem;
+    c->cap = cap;
+    return 0;
+}
+
+static void is_set_range(uint64_t *bits, unsigned int from, unsigned int to)
+{
+    unsigned int w = from / 64, last = to / 64;
+    uint64_t first = ~(uint64_t)0 << (from % 64);
+    uint64_t end = ~(uint64_t)0 >> (63 - to % 64);
+
+    if (w == last)
+    {
+        bits[w] |= first & end;
+        return;
+    }
+
+    bits[w++] |= first;
+    while (w < last)
+        bits[w++] = ~(uint64_t)0;
+    bits[last] |= end;
+}
+
+static void is_to_bitmap(struct iscont *c, uint64_t *bits)
+{
+    size_t i;
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            for (i = 0; i < c->len; i++)
+                bits[ARRAY(c)[i] / 64] |= (uint64_t)1 << ARRAY(c)[i] % 64;
+            break;
+
+        case IS_BITMAP:
+            for (i = 0; i < IS_WORDS; i++)
+                bits[i] |= BITS(c)[i];
+            break;
+
+        case IS_RUN:
+            for (i = 0; i < c->len; i++)
+                is_set_range(bits, RUNS(c)[i].start, RUNS(c)[i].last);
+            break;
+    }
+}
+
+static size_t is_bits_array(const uint64_t *bits, uint16_t *out)
+{
+    size_t w, n = 0;
+    uint64_t x;
+
+    for (w = 0; w < IS_WORDS; w++)
+    {
+        for (x = bits[w]; x; x &= x - 1)
+        {
+            if (out)
+                out[n] = w * 64 + is_ctz(x);
+            n++;
+        }
+    }
+    return n;
+}
+
+static size_t is_bits_runs(const uint64_t *bits, struct isrun *out)
+{
+    size_t w, n = 0;
+    unsigned long start = 0;
+    unsigned int b;
+    int in_run = 0;
+    uint64_t x;
+
+    for (w = 0; w < IS_WORDS; w++)
+    {
+        /* jump from one change between 0 and 1 to the next */
+        for (b = 0; b < 64; in_run = !in_run)
+        {
+            x = ((in_run) ? ~bits[w] : bits[w]) >> b;
+            if (!x)
+                break;
+            b += is_ctz(x);
+
+            if (!in_run)
+                start = w * 64 + b;
+            else
+            {
+                if (out)
+                {
+                    out[n].start = start;
+                    out[n].last = w * 64 + b - 1;
+                }
+                n++;
+            }
+        }
+    }
+
+    if (in_run)
+    {
+        if (out)
+        {
+            out[n].start = start;
+            out[n].last = 65535;
+        }
+        n++;
+    }
+    return n;
+}
+
+static int is_convert(struct iscont *c, enum iscont_type type)
+{
+    uint64_t *bits, *tmp = NULL;
+    void *mem;
+    size_t len = 0;
+
+    if (c->type == type)
+        return 0;
+
+    /* go through a bitmap */
+    if (c->type == IS_BITMAP)
+        bits = BITS(c);
+    else
+    {
+        if (!(tmp = calloc(IS_WORDS, sizeof *tmp)))
+            return -1;
+        is_to_bitmap(c, tmp);
+        bits = tmp;
+    }
+
+    switch (type)
+    {
+        case IS_BITMAP:
+            mem = tmp;
+            tmp = NULL;
+            break;
+
+        case IS_ARRAY:
+            len = c->n;
+            if ((mem = malloc((len) ? len * sizeof(uint16_t) : 1)))
+                is_bits_array(bits, mem);
+            break;
+
+        case IS_RUN:
+        default:
+            len = is_bits_runs(bits, NULL);
+            if ((mem = malloc((len) ? len * sizeof(struct isrun) : 1)))
+                is_bits_runs(bits, mem);
+            break;
+    }
+
+    free(tmp);
+    if (!mem)
+        return -1;
+
+    free(c->mem);
+    c->mem = mem;
+    c->type = type;
+    c->len = c->cap = len;
+    return 0;
+}
+
+static void is_fix(struct iscont *c)
+{
+    size_t best = (c->n <= IS_ARRAY_MAX) ?
+        c->n * sizeof(uint16_t) : IS_BITMAP_BYTES;
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            if (c->n > IS_ARRAY_MAX)
+                is_convert(c, IS_BITMAP);
+            break;
+
+        case IS_BITMAP:
+            if (c->n <= IS_ARRAY_MAX)
+                is_convert(c, IS_ARRAY);
+            break;
+
+        case IS_RUN:
+            if (c->len * sizeof(struct isrun) > best)
+                is_convert(c, (c->n <= IS_ARRAY_MAX) ? IS_ARRAY : IS_BITMAP);
+            break;
+    }
+}
+
+static int is_cont_contains(struct iscont *c, unsigned int low)
+{
+    size_t i;
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            i = is_bisect(ARRAY(c), c->len, low);
+            return (i < c->len && ARRAY(c)[i] == low);
+
+        case IS_BITMAP:
+            return IS_BIT(BITS(c), low);
+
+        case IS_RUN:
+        default:
+            i = is_run_find(RUNS(c), c->len, low);
+            return (i && low <= RUNS(c)[i - 1].last);
+    }
+}
+
+static int is_cont_insert(struct iscont *c, unsigned int low)
+{
+    struct isrun *r;
+    size_t i;
+    int left, right;
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            i = is_bisect(ARRAY(c), c->len, low);
+            if (i < c->len && ARRAY(c)[i] == low)
+                return 1;
+            if (is_reserve(c, sizeof(uint16_t)))
+                return -1;
+
+            memmove(ARRAY(c) + i + 1, ARRAY(c) + i,
+                    (c->len - i) * sizeof(uint16_t));
+            ARRAY(c)[i] = low;
+            c->len++;
+            break;
+
+        case IS_BITMAP:
+            if (IS_BIT(BITS(c), low))
+                return 1;
+            BITS(c)[low / 64] |= (uint64_t)1 << low % 64;
+            break;
+
+        case IS_RUN:
+            r = RUNS(c);
+            i = is_run_find(r, c->len, low);
+            if (i && low <= r[i - 1].last)
+                return 1;
+
+            /* extend the neighbouring runs, merge them or add a new one */
+            left = (i && r[i - 1].last + 1 == low);
+            right = (i < c->len && r[i].start == low + 1);
+
+            if (left && right)
+            {
+                r[i - 1].last = r[i].last;
+                memmove(r + i, r + i + 1, (c->len - i - 1) * sizeof *r);
+                c->len--;
+            }
+            else if (left)
+                r[i - 1].last = low;
+            else if (right)
+                r[i].start = low;
+            else
+            {
+                if (is_reserve(c, sizeof *r))
+                    return -1;
+                r = RUNS(c);
+                memmove(r + i + 1, r + i, (c->len - i) * sizeof *r);
+                r[i].start = r[i].last = low;
+                c->len++;
+            }
+            break;
+    }
+
+    c->n++;
+    is_fix(c);
+    return 0;
+}
+
+static int is_cont_remove(struct iscont *c, unsigned int low)
+{
+    struct isrun *r;
+    size_t i;
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            i = is_bisect(ARRAY(c), c->len, low);
+            if (i == c->len || ARRAY(c)[i] != low)
+                return 1;
+
+            memmove(ARRAY(c) + i, ARRAY(c) + i + 1,
+                    (c->len - i - 1) * sizeof(uint16_t));
+            c->len--;
+            break;
+
+        case IS_BITMAP:
+            if (!IS_BIT(BITS(c), low))
+                return 1;
+            BITS(c)[low / 64] &= ~((uint64_t)1 << low % 64);
+            break;
+
+        case IS_RUN:
+            r = RUNS(c);
+            i = is_run_find(r, c->len, low);
+            if (!i || low > r[--i].last)
+                return 1;
+
+            if (r[i].start == r[i].last)
+            {
+                memmove(r + i, r + i + 1, (c->len - i - 1) * sizeof *r);
+                c->len--;
+            }
+            else if (low == r[i].start)
+                r[i].start++;
+            else if (low == r[i].last)
+                r[i].last--;
+            else
+            {
+                /* split the run */
+                if (is_reserve(c, sizeof *r))
+                    return -1;
+                r = RUNS(c);
+                memmove(r + i + 1, r + i, (c->len - i) * sizeof *r);
+                r[i].last = low - 1;
+                r[i + 1].start = low + 1;
+                c->len++;
+            }
+            break;
+    }
+
+    c->n--;
+    is_fix(c);
+    return 0;
+}
+
+static size_t is_cont_rank(struct iscont *c, unsigned int low)
+{
+    size_t i, n = 0;
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            return is_bisect(ARRAY(c), c->len, low);
+
+        case IS_BITMAP:
+            for (i = 0; i < low / 64; i++)
+                n += is_popcount(BITS(c)[i]);
+            if (low % 64)
+                n += is_popcount(BITS(c)[i] << (64 - low % 64));
+            return n;
+
+        case IS_RUN:
+        default:
+            for (i = 0; i < c->len && RUNS(c)[i].last < low; i++)
+                n += RUNS(c)[i].last - RUNS(c)[i].start + 1;
+            if (i < c->len && RUNS(c)[i].start < low)
+                n += low - RUNS(c)[i].start;
+            return n;
+    }
+}
+
+static size_t is_cont_range(struct iscont *c, unsigned int lo,
+        unsigned int hi, void (*callback)(long, void*), void *arg)
+{
+    struct isrun *r;
+    size_t i, w, n = 0;
+    unsigned int v, end;
+    uint64_t x;
+
+    if (!callback)
+    {
+        n = (hi < 65535) ? is_cont_rank(c, hi + 1) : c->n;
+        return n - is_cont_rank(c, lo);
+    }
+
+    switch (c->type)
+    {
+        case IS_ARRAY:
+            for (i = is_bisect(ARRAY(c), c->len, lo);
+                    i < c->len && ARRAY(c)[i] <= hi; i++, n++)
+                callback(is_join(c->high, ARRAY(c)[i]), arg);
+            break;
+
+        case IS_BITMAP:
+            for (w = lo / 64; w <= hi / 64; w++)
+            {
+                x = BITS(c)[w];
+                if (w == lo / 64)
+                    x &= ~(uint64_t)0 << lo % 64;
+                if (w == hi / 64)
+                    x &= ~(uint64_t)0 >> (63 - hi % 64);
+
+                for (; x; x &= x - 1, n++)
+                    callback(is_join(c->high, w * 64 + is_ctz(x)), arg);
+            }
+            break;
+
+        case IS_RUN:
+            r = RUNS(c);
+            i = is_run_find(r, c->len, lo);
+            if (i && r[i - 1].last >= lo)
+                i--;
+
+            for (; i < c->len && r[i].start <= hi; i++)
+            {
+                v = (r[i].start > lo) ? r[i].start : lo;
+                end = (r[i].last < hi) ? r[i].last : hi;
+                for (; v <= end; v++, n++)
+                    callback(is_join(c->high, v), arg);
+            }
+            break;
+    }
+    return n;
+}
+
+static int is_cont_copy(struct iscont *dst, struct iscont *src)
+{
+    size_t size;
+
+    switch (src->type)
+    {
+        case IS_ARRAY:
+            size = src->len * sizeof(uint16_t);
+            break;
+        case IS_BITMAP:
+            size = IS_BITMAP_BYTES;
+            break;
+        case IS_RUN:
+        default:
+            size = src->len * sizeof(struct isrun);
+            break;
+    }
+
+    *dst = *src;
+    dst->cap = dst->len;
+    if (!(dst->mem = malloc((size) ? size : 1)))
+        return -1;
+
+    memcpy(dst->mem, src->mem, size);
+    return 0;
+}
+
+static int is_cont_bits(struct iscont *dst, uint64_t *bits)
+{
+    size_t i;
+
+    dst->type = IS_BITMAP;
+    dst->mem = bits;
+    dst->len = dst->cap = 0;
+    for (i = dst->n = 0; i < IS_WORDS; i++)
+        dst->n += is_popcount(bits[i]);
+
+    if (!dst->n)
+    {
+        free(bits);
+        dst->mem = NULL;
+        return 0;
+    }
+
+    is_fix(dst);
+    return 0;
+}
+
+static int is_cont_union(struct iscont *dst, struct iscont *a,
+        struct iscont *b)
+{
+    uint64_t *bits;
+    uint16_t *x, *y, *out;
+    size_t i, j, k, w;
+
+    dst->high = a->high;
+
+    /* small arrays are merged */
+    if (a->type == IS_ARRAY && b->type == IS_ARRAY &&
+            a->n + b->n <= IS_ARRAY_MAX)
+    {
+        if (!(out = malloc((a->n + b->n) * sizeof *out + 1)))
+            return -1;
+
+        x = ARRAY(a);
+        y = ARRAY(b);
+        for (i = j = k = 0; i < a->n || j < b->n; )
+        {
+            if (j == b->n || (i < a->n && x[i] < y[j]))
+                out[k++] = x[i++];
+            else if (i == a->n || y[j] < x[i])
+                out[k++] = y[j++];
+            else
+            {
+                out[k++] = x[i++];
+                j++;
+            }
+        }
+
+        dst->type = IS_ARRAY;
+        dst->mem = out;
+        dst->n = dst->len = dst->cap = k;
+        return 0;
+    }
+
+    if (!(bits = malloc(IS_BITMAP_BYTES)))
+        return -1;
+
+    if (a->type == IS_BITMAP && b->type == IS_BITMAP)
+    {
+        for (w = 0; w < IS_WORDS; w++)
+            bits[w] = BITS(a)[w] | BITS(b)[w];
+    }
+    else
+    {
+        memset(bits, 0, IS_BITMAP_BYTES);
+        is_to_bitmap(a, bits);
+        is_to_bitmap(b, bits);
+    }
+    return is_cont_bits(dst, bits);
+}
+
+static int is_cont_intersect(struct iscont *dst, struct iscont *a,
+        struct iscont *b)
+{
+    struct iscont *t;
+    uint64_t *bits, *other;
+    uint16_t *x, *y, *out;
+    size_t i, j, k, w;
+
+    dst->high = a->high;
+
+    if (b->type == IS_ARRAY && a->type != IS_ARRAY)
+    {
+        t = a;
+        a = b;
+        b = t;
+    }
+
+    /* an array keeps the keys the other container has too */
+    if (a->type == IS_ARRAY)
+    {
+        if (!(out = malloc(a->n * sizeof *out + 1)))
+            return -1;
+
+        x = ARRAY(a);
+        k = 0;
+        if (b->type == IS_ARRAY)
+        {
+            y = ARRAY(b);
+            for (i = j = 0; i < a->n && j < b->n; )
+            {
+                if (x[i] < y[j])
+                    i++;
+                else if (y[j] < x[i])
+                    j++;
+                else
+                {
+                    out[k++] = x[i++];
+                    j++;
+                }
+            }
+        }
+        else
+        {
+            for (i = 0; i < a->n; i++)
+            {
+                if (is_cont_contains(b, x[i]))
+                    out[k++] = x[i];
+            }
+        }
+
+        dst->type = IS_ARRAY;
+        dst->mem = out;
+        dst->n = dst->len = dst->cap = k;
+        if (!k)
+        {
+            free(out);
+            dst->mem = NULL;
+        }
+        return 0;
+    }
+
+    if (!(bits = malloc(IS_BITMAP_BYTES)))
+        return -1;
+
+    if (a->type == IS_BITMAP)
+        memcpy(bits, BITS(a), IS_BITMAP_BYTES);
+    else
+    {
+        memset(bits, 0, IS_BITMAP_BYTES);
+        is_to_bitmap(a, bits);
+    }
+
+    if (b->type == IS_BITMAP)
+        other = BITS(b);
+    else if ((other = calloc(IS_WORDS, sizeof *other)))
+        is_to_bitmap(b, other);
+    else
+    {
+        free(bits);
+        return -1;
+    }
+
+    for (w = 0; w < IS_WORDS; w++)
+        bits[w] &= other[w];
+
+    if (other != BITS(b))
+        free(other);
+    return is_cont_bits(dst, bits);
+}
+
+static int is_append(intset *s, struct iscont *c)
+{
+    struct iscont *conts;
+    size_t cap;
+
+    if (s->len == s->cap)
+    {
+        cap = (s->cap) ? 2 * s->cap : 4;
+        if (!(conts = realloc(s->conts, cap * sizeof *conts)))
+            return -1;
+        s->conts = conts;
+        s->cap = cap;
+    }
+
+    s->conts[s->len++] = *c;
+    s->n += c->n;
+    return 0;
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+/*============*/
+/* management */
+/*============*/
+
+intset *intset_init(void)
+{
+    intset *s;
+
+    if (!(s = malloc(sizeof *s)))
+        return NULL;
+
+    s->conts = NULL;
+    s->len = s->cap = 0;
+    s->n = 0;
+    return s;
+}
+
+void intset_clear(intset *s)
+{
+    size_t i;
+
+    if (!s)
+        return;
+
+    for (i = 0; i < s->len; i++)
+        free(s->conts[i].mem);
+    s->len = 0;
+    s->n = 0;
+}
+
+void intset_free(intset *s)
+{
+    if (!s)
+        return;
+
+    intset_clear(s);
+    free(s->conts);
+    free(s);
+}
+
+size_t intset_size(intset *s)
+{
+    return (s) ? s->n : 0;
+}
+
+void intset_optimize(intset *s)
+{
+    struct iscont *c;
+    uint64_t *bits;
+    void *mem;
+    size_t i, size;
+
+    if (!s || !(bits = malloc(IS_BITMAP_BYTES)))
+        return;
+
+    for (i = 0; i < s->len; i++)
+    {
+        c = &s->conts[i];
+        if (c->type == IS_RUN)
+            continue;
+
+        size = (c->type == IS_BITMAP) ?
+            IS_BITMAP_BYTES : c->len * sizeof(uint16_t);
+
+        memset(bits, 0, IS_BITMAP_BYTES);
+        is_to_bitmap(c, bits);
+        if (is_bits_runs(bits, NULL) * sizeof(struct isrun) < size)
+            is_convert(c, IS_RUN);
+        else if (c->type == IS_ARRAY && c->cap > c->len &&
+                (mem = realloc(c->mem, c->len * sizeof(uint16_t))))
+        {
+            /* drop the spare room */
+            c->mem = mem;
+            c->cap = c->len;
+        }
+    }
+    free(bits);
+}
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+int intset_insert(intset *s, long key)
+{
+    struct iscont *c, *conts;
+    unsigned long high;
+    unsigned int low;
+    size_t pos, cap;
+
+    if (!s)
+        return -1;
+
+    is_split(key, &high, &low);
+    if (!is_find(s, high, &pos))
+    {
+        if (s->len == s->cap)
+        {
+            cap = (s->cap) ? 2 * s->cap : 4;
+            if (!(conts = realloc(s->conts, cap * sizeof *conts)))
+                return -1;
+            s->conts = conts;
+            s->cap = cap;
+        }
+
+        memmove(s->conts + pos + 1, s->conts + pos,
+                (s->len - pos) * sizeof *s->conts);
+        s->len++;
+
+        c = &s->conts[pos];
+        c->high = high;
+        c->type = IS_ARRAY;
+        c->n = c->len = c->cap = 0;
+        c->mem = NULL;
+    }
+    c = &s->conts[pos];
+
+    if (is_cont_insert(c, low))
+    {
+        /* don't keep a container created for nothing */
+        if (!c->n)
+        {
+            free(c->mem);
+            memmove(s->conts + pos, s->conts + pos + 1,
+                    (--s->len - pos) * sizeof *s->conts);
+        }
+        return -1;
+    }
+
+    s->n++;
+    return 0;
+}
+
+int intset_remove(intset *s, long key)
+{
+    struct iscont *c;
+    unsigned long high;
+    unsigned int low;
+    size_t pos;
+
+    if (!s)
+        return -1;
+
+    is_split(key, &high, &low);
+    if (!is_find(s, high, &pos) || is_cont_remove(&s->conts[pos], low))
+        return -1;
+
+    c = &s->conts[pos];
+    if (!c->n)
+    {
+        free(c->mem);
+        memmove(s->conts + pos, s->conts + pos + 1,
+                (--s->len - pos) * sizeof *s->conts);
+    }
+
+    s->n--;
+    return 0;
+}
+
+int intset_contains(intset *s, long key)
+{
+    unsigned long high;
+    unsigned int low;
+    size_t pos;
+
+    if (!s)
+        return 0;
+
+    is_split(key, &high, &low);
+    return is_find(s, high, &pos) && is_cont_contains(&s->conts[pos], low);
+}
+
+size_t intset_rank(intset *s, long key)
+{
+    unsigned long high;
+    unsigned int low;
+    size_t pos, i, n = 0;
+
+    if (!s)
+        return 0;
+
+    is_split(key, &high, &low);
+    if (is_find(s, high, &pos))
+        n = is_cont_rank(&s->conts[pos], low);
+
+    for (i = 0; i < pos; i++)
+        n += s->conts[i].n;
+    return n;
+}
+
+size_t intset_range(intset *s, long lo, long hi,
+        void (*callback)(long, void*), void *arg)
+{
+    struct iscont *c;
+    unsigned long high_lo, high_hi;
+    unsigned int low_lo, low_hi;
+    size_t pos, count = 0;
+
+    if (!s || lo > hi)
+        return 0;
+
+    is_split(lo, &high_lo, &low_lo);
+    is_split(hi, &high_hi, &low_hi);
+
+    is_find(s, high_lo, &pos);
+    for (; pos < s->len && s->conts[pos].high <= high_hi; pos++)
+    {
+        c = &s->conts[pos];
+        count += is_cont_range(c,
+                (c->high == high_lo) ? low_lo : 0,
+                (c->high == high_hi) ? low_hi : 65535, callback, arg);
+    }
+    return count;
+}
+
+
+/*================*/
+/* set operations */
+/*================*/
+
+intset *intset_union(intset *a, intset *b)
+{
+    intset *s;
+    struct iscont c;
+    size_t i = 0, j = 0;
+    int err;
+
+    if (!a || !b || !(s = intset_init()))
+        return NULL;
+
+    while (i < a->len || j < b->len)
+    {
+        if (j == b->len || (i < a->len && a->conts[i].high < b->conts[j].high))
+            err = is_cont_copy(&c, &a->conts[i++]);
+        else if (i == a->len || b->conts[j].high < a->conts[i].high)
+            err = is_cont_copy(&c, &b->conts[j++]);
+        else
+            err = is_cont_union(&c, &a->conts[i++], &b->conts[j++]);
+
+        if (err || is_append(s, &c))
+        {
+            if (!err)
+                free(c.mem);
+            intset_free(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+intset *intset_intersect(intset *a, intset *b)
+{
+    intset *s;
+    struct iscont c;
+    size_t i = 0, j = 0;
+
+    if (!a || !b || !(s = intset_init()))
+        return NULL;
+
+    while (i < a->len && j < b->len)
+    {
+        if (a->conts[i].high < b->conts[j].high)
+            i++;
+        else if (b->conts[j].high < a->conts[i].high)
+            j++;
+        else
+        {
+            if (is_cont_intersect(&c, &a->conts[i++], &b->conts[j++]))
+            {
+                intset_free(s);
+                return NULL;
+            }
+
+            if (c.n && is_append(s, &c))
+            {
+                free(c.mem);
+                intset_free(s);
+                return NULL;
+            }
+        }
+    }
+    return s;
+}
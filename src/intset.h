@@ -0,0 +1,101 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTSET_H
+#define INTSET_H
+
+/* compressed set of longs (roaring bitmap style): the keys are grouped by
+ * their upper bits into containers of 65536 possible keys, each stored as
+ * a sorted array, a bitmap or a list of runs, whichever is smallest */
+
+#include <stddef.h>
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct intset intset;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* create an empty set, or NULL on error */
+intset *intset_init(void);
+
+/* remove all keys */
+void intset_clear(intset *s);
+
+/* free a set */
+void intset_free(intset *s);
+
+/* number of keys */
+size_t intset_size(intset *s);
+
+/* store containers with long runs of consecutive keys as runs if that
+ * takes less memory; call after inserting many keys */
+void intset_optimize(intset *s);
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* insert key; returns -1 if it's in the set already or on error */
+int intset_insert(intset *s, long key);
+
+/* remove key; returns -1 if it isn't in the set */
+int intset_remove(intset *s, long key);
+
+/* return non-zero if key is in the set */
+int intset_contains(intset *s, long key);
+
+/* return the number of keys < key */
+size_t intset_rank(intset *s, long key);
+
+/* call callback(key, arg) on all keys with lo <= key <= hi in ascending
+ * order; returns the number of keys */
+size_t intset_range(intset *s, long lo, long hi,
+        void (*callback)(long, void*), void *arg);
+
+
+/*================*/
+/* set operations */
+/*================*/
+
+/* create a set with the keys in a or b / in a and b, or NULL on error;
+ * bitmap containers are combined a word at a time */
+intset *intset_union(intset *a, intset *b);
+intset *intset_intersect(intset *a, intset *b);
+
+#endif
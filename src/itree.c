@@ -0,0 +1,335 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "itree.h"
+#include "bst.h"
+
+#include <stdlib.h>
+#include <limits.h>
+
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*========*/
+/* macros */
+/*========*/
+
+/* number of intervals per chunk allocated by itree_insert() */
+#define ITREE_CHUNK 256
+
+
+/*=========*/
+/* structs */
+/*=========*/
+
+/* the bst's data for an interval; start is the bst's key */
+struct itreeitem
+{
+    long end;
+    /* next free item while unused */
+    void *data;
+};
+
+struct itreechunk
+{
+    struct itreechunk *next;
+    size_t used, n;
+    struct itreeitem items[1];
+};
+
+struct itree
+{
+    bst *t;
+    struct itreechunk *chunks;
+    struct itreeitem *free;
+};
+
+/* callback and argument of a query */
+struct itreequery
+{
+    void (*callback)(long, long, void*, void*);
+    void *arg;
+};
+
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* the value the bst is augmented with */
+static long itree_end(long start, void *item);
+
+/* get an unused item */
+static struct itreeitem *itree_alloc(itree *t);
+
+/* add an empty chunk for n items */
+static int itree_grow(itree *t, size_t n);
+
+/* bst_range() callbacks */
+static void itree_query_cb(long start, void *item, void *arg);
+static void itree_clear_cb(long start, void *item, void *arg);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static long itree_end(long start, void *item)
+{
+    return ((struct itreeitem*)item)->end;
+}
+
+static struct itreeitem *itree_alloc(itree *t)
+{
+    struct itreeitem *it;
+
+    if ((it = t->free))
+    {
+        t->free = it->data;
+        return it;
+    }
+
+    if ((!t->chunks || t->chunks->used == t->chunks->n) &&
+            itree_grow(t, ITREE_CHUNK))
+        return NULL;
+
+    return &t->chunks->items[t->chunks->used++];
+}
+
+static int itree_grow(itree *t, size_t n)
+{
+    struct itreechunk *c;
+
+    c = malloc(sizeof *c + (n - 1) * sizeof(struct itreeitem));
+    if (!c)
+        return -1;
+
+    c->used = 0;
+    c->n = n;
+    c->next = t->chunks;
+    t->chunks = c;
+    return 0;
+}
+
+static void itree_query_cb(long start, void *item, void *arg)
+{
+    struct itreeitem *it = item;
+    struct itreequery *q = arg;
+
+    q->callback(start, it->end, it->data, q->arg);
+}
+
+static void itree_clear_cb(long start, void *item, void *arg)
+{
+    void (*callback)(void*) = *(void (**)(void*))arg;
+
+    callback(((struct itreeitem*)item)->data);
+}
+
+
+/**********************/
+/* EXPORTED FUNCTIONS */
+/**********************/
+
+itree *itree_init(void)
+{
+    itree *t;
+
+    if (!(t = malloc(sizeof *t)))
+        return NULL;
+
+    t->chunks = NULL;
+    t->free = NULL;
+
+    if (!(t->t = bst_init_o(BST_MULTI)) ||
+            bst_augment(t->t, &bstmonoid_max, itree_end))
+    {
+        bst_free(t->t, NULL);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+itree *itree_build_sorted(const long *starts, const long *ends,
+        void **data, size_t n)
+{
+    itree *t;
+    void **items;
+    struct itreeitem *it;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (ends[i] <= starts[i] || (i && starts[i - 1] > starts[i]))
+            return NULL;
+    }
+
+    if (!n)
+        return itree_init();
+
+    if (!(t = malloc(sizeof *t)))
+        return NULL;
+
+    t->chunks = NULL;
+    t->free = NULL;
+    t->t = NULL;
+    items = NULL;
+
+    /* all intervals go into one chunk */
+    if (itree_grow(t, n) || !(items = malloc(n * sizeof *items)))
+        goto error;
+
+    for (i = 0; i < n; i++)
+    {
+        it = &t->chunks->items[i];
+        it->end = ends[i];
+        it->data = (data) ? data[i] : NULL;
+        items[i] = it;
+    }
+    t->chunks->used = n;
+
+    if (!(t->t = bst_build_sorted_o(starts, items, n, BST_MULTI)) ||
+            bst_augment(t->t, &bstmonoid_max, itree_end))
+        goto error;
+
+    free(items);
+    return t;
+
+error:
+    free(items);
+    itree_free(t, NULL);
+    return NULL;
+}
+
+void itree_clear(itree *t, void (*callback)(void*))
+{
+    struct itreechunk *c;
+
+    if (!t)
+        return;
+
+    if (callback)
+        bst_range(t->t, LONG_MIN, LONG_MAX, itree_clear_cb, &callback);
+
+    bst_clear(t->t, NULL);
+
+    while ((c = t->chunks))
+    {
+        t->chunks = c->next;
+        free(c);
+    }
+    t->free = NULL;
+}
+
+void itree_free(itree *t, void (*callback)(void*))
+{
+    if (!t)
+        return;
+
+    itree_clear(t, callback);
+    bst_free(t->t, NULL);
+    free(t);
+}
+
+size_t itree_size(itree *t)
+{
+    return (t) ? bst_size(t->t) : 0;
+}
+
+int itree_insert(itree *t, long start, long end, void *data)
+{
+    struct itreeitem *it;
+
+    if (!t || end <= start || !(it = itree_alloc(t)))
+        return -1;
+
+    it->end = end;
+    it->data = data;
+
+    if (bst_insert(t->t, start, it))
+    {
+        it->data = t->free;
+        t->free = it;
+        return -1;
+    }
+    return 0;
+}
+
+int itree_remove(itree *t, long start, long end, void *data)
+{
+    struct itreeitem *it;
+    bstiter iter;
+
+    if (!t || bst_get_all(t->t, start, &iter))
+        return -1;
+
+    while (bstiter_next(&iter, NULL, (void**)&it))
+    {
+        if (it->end != end || it->data != data)
+            continue;
+
+        if (bst_remove_data(t->t, start, it, NULL))
+            return -1;
+
+        it->data = t->free;
+        t->free = it;
+        return 0;
+    }
+    return -1;
+}
+
+size_t itree_stab(itree *t, long x,
+        void (*callback)(long, long, void*, void*), void *arg)
+{
+    struct itreequery q;
+
+    if (!t)
+        return 0;
+
+    q.callback = callback;
+    q.arg = arg;
+
+    /* start <= x and end > x */
+    return bst_range_above(t->t, LONG_MIN, x, x,
+            (callback) ? itree_query_cb : NULL, &q);
+}
+
+size_t itree_overlap(itree *t, long lo, long hi,
+        void (*callback)(long, long, void*, void*), void *arg)
+{
+    struct itreequery q;
+
+    if (!t || hi <= lo)
+        return 0;
+
+    q.callback = callback;
+    q.arg = arg;
+
+    /* start < hi and end > lo */
+    return bst_range_above(t->t, LONG_MIN, hi - 1, lo,
+            (callback) ? itree_query_cb : NULL, &q);
+}
@@ -0,0 +1,94 @@
+/* Copyright (c) 2012 Robin Martinjak.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1.  Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    nd/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ITREE_H
+#define ITREE_H
+
+/* set of half-open intervals [start, end), kept in a bst ordered by start
+ * and augmented with the maximum end of each subtree, so that queries only
+ * descend into subtrees that contain a matching interval */
+
+#include <stddef.h>
+
+/***********/
+/* DEFINES */
+/***********/
+
+/*==========*/
+/* typedefs */
+/*==========*/
+
+typedef struct itree itree;
+
+
+/*************/
+/* FUNCTIONS */
+/*************/
+
+/*============*/
+/* management */
+/*============*/
+
+/* create an empty interval tree, or NULL on error */
+itree *itree_init(void);
+
+/* create an interval tree from n intervals in O(n); starts must be
+ * ascending and every end > start (else NULL is returned), data may be
+ * NULL */
+itree *itree_build_sorted(const long *starts, const long *ends,
+        void **data, size_t n);
+
+/* remove all intervals, calling callback(data) on each if not NULL */
+void itree_clear(itree *t, void (*callback)(void*));
+
+/* free an interval tree, calling callback(data) on each if not NULL */
+void itree_free(itree *t, void (*callback)(void*));
+
+/* number of intervals */
+size_t itree_size(itree *t);
+
+
+/*=================*/
+/* data operations */
+/*=================*/
+
+/* insert [start, end) in O(log n); the same interval may be inserted more
+ * than once. returns -1 if end <= start or on error */
+int itree_insert(itree *t, long start, long end, void *data);
+
+/* remove an interval [start, end) with this data, returns -1 if there is
+ * none */
+int itree_remove(itree *t, long start, long end, void *data);
+
+/* call callback(start, end, data, arg) on all intervals with
+ * start <= x < end, ordered by start; returns the number of intervals */
+size_t itree_stab(itree *t, long x,
+        void (*callback)(long, long, void*, void*), void *arg);
+
+/* call callback(start, end, data, arg) on all intervals overlapping
+ * [lo, hi), ordered by start; returns the number of intervals */
+size_t itree_overlap(itree *t, long lo, long hi,
+        void (*callback)(long, long, void*, void*), void *arg);
+
+#endif
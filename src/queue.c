@@ -31,21 +31,60 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* DEFINES */
 /***********/
 
+/*========*/
+/* macros */
+/*========*/
+
+/* capacity of a non-empty queue; capacities are powers of two */
+#define Q_MIN_CAP 8
+
+/* position of the i-th item */
+#define Q_AT(q, i) (((q)->head + (i)) & ((q)->cap - 1))
+
+
 /*=========*/
 /* structs */
 /*=========*/
 
-struct qnode
+/* circular buffer; the items are head, head + 1, ... (mod cap) */
+struct queue
 {
-    void *data;
-    struct qnode *next;
+    void **items;
+    size_t head;
+    size_t count;
+    size_t cap;
 };
 
-struct queue
+
+/*===================*/
+/* static prototypes */
+/*===================*/
+
+/* move the items to a buffer of cap entries, returns -1 on error */
+static int q_resize(queue *q, size_t cap);
+
+
+/********************/
+/* STATIC FUNCTIONS */
+/********************/
+
+static int q_resize(queue *q, size_t cap)
 {
-    struct qnode *head;
-    struct qnode *tail;
-};
+    void **items;
+    size_t i;
+
+    if (!(items = malloc(cap * sizeof *items)))
+        return -1;
+
+    for (i = 0; i < q->count; i++)
+        items[i] = q->items[Q_AT(q, i)];
+
+    free(q->items);
+    q->items = items;
+    q->head = 0;
+    q->cap = cap;
+    return 0;
+}
 
 
 /**********************/
@@ -58,8 +97,10 @@ queue *q_init(void)
 
     if (q)
     {
-        q->head = NULL;
-        q->tail = NULL;
+        q->items = NULL;
+        q->head = 0;
+        q->count = 0;
+        q->cap = 0;
     }
 
     return q;
@@ -67,13 +108,19 @@ queue *q_init(void)
 
 void q_clear(queue *q, void (*callback)(void*))
 {
-    void *del;
-    while (q->head)
+    size_t i;
+
+    if (callback)
     {
-        del = q_dequeue(q);
-        if (callback)
-            callback(del);
+        for (i = 0; i < q->count; i++)
+            callback(q->items[Q_AT(q, i)]);
     }
+
+    free(q->items);
+    q->items = NULL;
+    q->head = 0;
+    q->count = 0;
+    q->cap = 0;
 }
 
 void q_free(queue *q, void (*callback)(void*))
@@ -84,71 +131,58 @@ void q_free(queue *q, void (*callback)(void*))
 
 int q_enqueue(queue *q, void *data)
 {
-    struct qnode *ins = malloc(sizeof *ins);
-    if (!ins)
+    if (q->count == q->cap &&
+            q_resize(q, (q->cap) ? 2 * q->cap : Q_MIN_CAP))
         return -1;
 
-    ins->data = data;
-    ins->next = NULL;
-
-    if (!q->head)
-        q->head = ins;
-    else
-        q->tail->next = ins;
-
-    q->tail = ins;
+    q->items[Q_AT(q, q->count)] = data;
+    q->count++;
     return 0;
 }
 
 int q_requeue(queue *q, void *data)
 {
-    struct qnode *ins = malloc(sizeof *ins);
-    if (!ins)
+    if (q->count == q->cap &&
+            q_resize(q, (q->cap) ? 2 * q->cap : Q_MIN_CAP))
         return -1;
 
-    ins->data = data;
-    ins->next = q->head;
-
-    q->head = ins;
-
-    if (!q->tail)
-        q->tail = ins;
-
+    q->head = (q->head - 1) & (q->cap - 1);
+    q->items[q->head] = data;
+    q->count++;
     return 0;
 }
 
 void *q_dequeue(queue *q)
 {
     void *ret;
-    struct qnode *del;
 
-    if (!q->head)
+    if (!q->count)
         return NULL;
 
-    ret = q->head->data;
-    del = q->head;
-
-    q->head = q->head->next;
-
-    if (!q->head)
-        q->tail = NULL;
+    ret = q->items[q->head];
+    q->head = Q_AT(q, 1);
+    q->count--;
 
-    free(del);
+    /* give memory back when mostly empty; halving at a quarter keeps a
+     * queue that grows and shrinks around a size from resizing often.
+     * Failing to shrink is no error */
+    if (q->cap > Q_MIN_CAP && q->count <= q->cap / 4)
+        q_resize(q, q->cap / 2);
 
     return ret;
 }
 
 int q_empty(queue *q)
 {
-    return (q->head == NULL);
+    return (q->count == 0);
 }
 
 int q_contains(queue *q, const void *data, int(*cmp)(const void*, const void*))
 {
-    struct qnode *p;
-    for (p = q->head; p; p = p->next)
+    size_t i;
+    for (i = 0; i < q->count; i++)
     {
-        if (cmp(data, p->data) == 0)
+        if (cmp(data, q->items[Q_AT(q, i)]) == 0)
             return 1;
     }
 
@@ -157,10 +191,10 @@ int q_contains(queue *q, const void *data, int(*cmp)(const void*, const void*))
 
 int q_contains2(queue *q, const void *data, int(*cmp)(const void*, const void*, void*), void *arg)
 {
-    struct qnode *p;
-    for (p = q->head; p; p = p->next)
+    size_t i;
+    for (i = 0; i < q->count; i++)
     {
-        if (cmp(data, p->data, arg) == 0)
+        if (cmp(data, q->items[Q_AT(q, i)], arg) == 0)
             return 1;
     }
 
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <time.h>
+#include <check.h>
+
+#include "betree.h"
+
+#define N 50000
+
+betree *t;
+long numbers[N];
+size_t dropped;
+
+
+static void drop(void *data)
+{
+    dropped++;
+}
+
+static void setup(void)
+{
+    size_t i, j;
+    long x;
+
+    dropped = 0;
+    t = bet_init(drop);
+
+    srand(time(NULL));
+
+    /* unique numbers in random order */
+    for (i=0; i<N; ++i)
+        numbers[i] = i * 3;
+    for (i=N-1; i>0; --i)
+    {
+        j = rand() % (i + 1);
+        x = numbers[i], numbers[i] = numbers[j], numbers[j] = x;
+    }
+}
+
+static void teardown(void)
+{
+    bet_free(t);
+}
+
+static void count_range(long key, void *data, void *arg)
+{
+    long *last = arg;
+    fail_unless(*(long*)data == key);
+    fail_unless(key > *last);
+    *last = key;
+}
+
+START_TEST (test_bet)
+{
+    size_t i;
+    long x, *p;
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bet_insert(t, numbers[i], &numbers[i]) == 0);
+        fail_unless(bet_contains(t, numbers[i]),
+                "failed assertion: bet_contains(t, %ld)\n", numbers[i]);
+    }
+
+    for (i=0; i<N; ++i)
+    {
+        p = bet_get(t, numbers[i]);
+        fail_unless(p && *p == numbers[i]);
+        fail_unless(!bet_contains(t, numbers[i] + 1));
+    }
+
+    x = 99;
+    fail_unless(bet_range(t, 100, 200, count_range, &x) == 33);
+    x = -1;
+    fail_unless(bet_range(t, 0, 3 * N, count_range, &x) == N);
+
+    /* replaced items are dropped once the update reaches them */
+    for (i=0; i<N/2; ++i)
+        fail_unless(bet_insert(t, numbers[i], &numbers[i]) == 0);
+    fail_unless(bet_range(t, 0, 3 * N, NULL, NULL) == N);
+    fail_unless(dropped == N/2);
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bet_remove(t, numbers[i]) == 0);
+        fail_unless(!bet_contains(t, numbers[i]),
+                "failed assertion: !bet_contains(t, %ld)\n", numbers[i]);
+
+        if (i == N/2)
+        {
+            x = -1;
+            fail_unless(bet_range(t, 0, 3 * N, count_range, &x) == N - i - 1);
+        }
+    }
+    fail_unless(bet_range(t, 0, 3 * N, NULL, NULL) == 0);
+    fail_unless(dropped == N/2 + N);
+
+    bet_insert(t, 1337, NULL);
+    fail_unless(bet_contains(t, 1337));
+    bet_clear(t);
+    fail_unless(!bet_contains(t, 1337));
+    fail_unless(dropped == N/2 + N + 1);
+}
+END_TEST
+
+START_TEST (test_bet_mixed)
+{
+    static char present[N];
+    size_t i, j, n = 0;
+    long x;
+
+    /* random updates, checked against a plain array */
+    for (i=0; i<8*N; ++i)
+    {
+        j = rand() % N;
+        if (rand() % 3)
+        {
+            fail_unless(bet_insert(t, numbers[j], &numbers[j]) == 0);
+            n += !present[j];
+            present[j] = 1;
+        }
+        else
+        {
+            fail_unless(bet_remove(t, numbers[j]) == 0);
+            n -= present[j];
+            present[j] = 0;
+        }
+
+        if (i % 997 == 0)
+        {
+            j = rand() % N;
+            fail_unless(!bet_contains(t, numbers[j]) == !present[j]);
+            fail_unless(bet_get(t, numbers[j]) == (present[j] ? &numbers[j] : NULL));
+        }
+
+        if (i % 49999 == 0)
+        {
+            x = -1;
+            fail_unless(bet_range(t, 0, 3 * N, count_range, &x) == n);
+        }
+    }
+
+    for (j=0; j<N; ++j)
+        fail_unless(!bet_contains(t, numbers[j]) == !present[j]);
+
+    bet_free(t);
+    t = bet_init(NULL);
+}
+END_TEST
+
+Suite *bet_suite(void)
+{
+    Suite *s = suite_create("B^e-tree");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_bet);
+    tcase_add_test(tc_simple, test_bet_mixed);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, bet_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <time.h>
+#include <check.h>
+
+#include "bptree.h"
+
+#define N 10000
+
+bptree *t;
+long numbers[N];
+
+
+static void setup(void)
+{
+    size_t i, j;
+    long x;
+
+    t = bpt_init();
+
+    srand(time(NULL));
+
+    /* unique numbers in random order */
+    for (i=0; i<N; ++i)
+        numbers[i] = i * 3;
+    for (i=N-1; i>0; --i)
+    {
+        j = rand() % (i + 1);
+        x = numbers[i], numbers[i] = numbers[j], numbers[j] = x;
+    }
+}
+
+static void teardown(void)
+{
+    bpt_free(t, NULL);
+}
+
+static void count_range(long key, void *data, void *arg)
+{
+    long *last = arg;
+    fail_unless(*(long*)data == key);
+    fail_unless(key > *last);
+    *last = key;
+}
+
+START_TEST (test_bpt)
+{
+    size_t i;
+    long x, *p;
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bpt_insert(t, numbers[i], &numbers[i]) == 0);
+        fail_unless(bpt_contains(t, numbers[i]),
+                "failed assertion: bpt_contains(t, %ld)\n", numbers[i]);
+    }
+    fail_unless(bpt_insert(t, numbers[0], NULL) == -1);
+
+    for (i=0; i<N; ++i)
+    {
+        p = bpt_get(t, numbers[i]);
+        fail_unless(p && *p == numbers[i]);
+        fail_unless(!bpt_contains(t, numbers[i] + 1));
+    }
+
+    x = -1;
+    fail_unless(bpt_range(t, 0, 3 * N, count_range, &x) == N);
+    x = 99;
+    fail_unless(bpt_range(t, 100, 200, count_range, &x) == 33);
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bpt_remove(t, numbers[i], NULL) == 0);
+        fail_unless(!bpt_contains(t, numbers[i]),
+                "failed assertion: !bpt_contains(t, %ld)\n", numbers[i]);
+
+        if (i == N/2)
+        {
+            x = -1;
+            fail_unless(bpt_range(t, 0, 3 * N, count_range, &x) == N - i - 1);
+        }
+    }
+    fail_unless(bpt_remove(t, numbers[0], NULL) == -1);
+    fail_unless(bpt_range(t, 0, 3 * N, NULL, NULL) == 0);
+
+    bpt_insert(t, 1337, NULL);
+    fail_unless(bpt_contains(t, 1337));
+    bpt_clear(t, NULL);
+    fail_unless(!bpt_contains(t, 1337));
+}
+END_TEST
+
+Suite *bpt_suite(void)
+{
+    Suite *s = suite_create("B+tree");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_bpt);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, bpt_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,8 +1,12 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
 #include <time.h>
 #include <check.h>
 
 #include "bst.h"
+#include "bstfrozen.h"
 
 #define N 10000
 
@@ -92,6 +96,622 @@ START_TEST (test_bst)
 }
 END_TEST
 
+static void count_range(long key, void *data, void *arg)
+{
+    long *last = arg;
+    fail_unless(*(long*)data == key);
+    fail_unless(key >= *last);
+    *last = key;
+}
+
+START_TEST (test_bst_order)
+{
+    long x, prev = 0, found, lo, hi;
+    void *data;
+    size_t i, j, count;
+    bstiter it;
+
+    fail_unless(bst_min(t, NULL, NULL) == -1);
+    fail_unless(bst_floor(t, 0, NULL, NULL) == -1);
+    bst_iter(t, &it, 0);
+    fail_unless(!bstiter_next(&it, NULL, NULL));
+
+    for (i=0; i<N; ++i)
+        bst_insert(t, numbers[i], &numbers[i]);
+
+    /* forward and reverse iteration */
+    bst_iter(t, &it, 0);
+    for (count=0; bstiter_next(&it, &x, &data); count++)
+    {
+        fail_unless(*(long*)data == x);
+        fail_unless(count == 0 || x >= prev);
+        prev = x;
+    }
+    fail_unless(count == N, "iterated %lu of %d items", (unsigned long)count, N);
+    fail_unless(bst_max(t, &x, NULL) == 0 && x == prev);
+
+    bst_iter(t, &it, 1);
+    for (count=0; bstiter_next(&it, &x, NULL); count++)
+    {
+        fail_unless(count == 0 || x <= prev);
+        prev = x;
+    }
+    fail_unless(count == N);
+    fail_unless(bst_min(t, &x, NULL) == 0 && x == prev);
+
+    for (j=0; j<100; ++j)
+    {
+        long fl = -1, ce = -1;
+
+        lo = rand();
+        hi = lo + RAND_MAX / 100;
+
+        count = 0;
+        for (i=0; i<N; ++i)
+        {
+            if (numbers[i] >= lo && numbers[i] <= hi)
+                count++;
+            if (numbers[i] <= lo && (fl == -1 || numbers[i] > fl))
+                fl = numbers[i];
+            if (numbers[i] >= lo && (ce == -1 || numbers[i] < ce))
+                ce = numbers[i];
+        }
+
+        x = lo;
+        fail_unless(bst_range(t, lo, hi, count_range, &x) == count);
+
+        if (fl == -1)
+            fail_unless(bst_floor(t, lo, NULL, NULL) == -1);
+        else
+            fail_unless(bst_floor(t, lo, &found, NULL) == 0 && found == fl);
+
+        if (ce == -1)
+        {
+            fail_unless(bst_ceil(t, lo, NULL, NULL) == -1);
+            fail_unless(bst_lower_bound(t, lo, &it) == -1);
+        }
+        else
+        {
+            fail_unless(bst_ceil(t, lo, &found, NULL) == 0 && found == ce);
+            fail_unless(bst_lower_bound(t, lo, &it) == 0);
+            fail_unless(bstiter_next(&it, &x, NULL) && x == ce);
+        }
+    }
+}
+END_TEST
+
+START_TEST (test_bst_rank)
+{
+    long x, prev = 0;
+    size_t i, n = 0;
+
+    fail_unless(bst_size(t) == 0);
+    fail_unless(bst_select(t, 0, NULL, NULL) == -1);
+
+    for (i=0; i<N; ++i)
+    {
+        if (bst_insert(t, numbers[i], &numbers[i]) == 0)
+            n++;
+    }
+    fail_unless(bst_size(t) == n);
+
+    for (i=0; i<n; ++i)
+    {
+        fail_unless(bst_select(t, i, &x, NULL) == 0);
+        fail_unless(i == 0 || x > prev);
+        fail_unless(bst_rank(t, x) == i);
+        fail_unless(bst_rank(t, x + 1) == i + 1);
+        prev = x;
+    }
+    fail_unless(bst_select(t, n, NULL, NULL) == -1);
+
+    for (i=0; i<N/2; ++i)
+    {
+        if (bst_remove(t, numbers[i], NULL) == 0)
+            n--;
+    }
+    fail_unless(bst_size(t) == n);
+    fail_unless(bst_select(t, n - 1, &x, NULL) == 0);
+    fail_unless(bst_max(t, &prev, NULL) == 0 && x == prev);
+    fail_unless(bst_rank(t, x) == n - 1);
+}
+END_TEST
+
+static int cmp_long(const void *a, const void *b)
+{
+    const long *x = a, *y = b;
+    return (*x > *y) - (*x < *y);
+}
+
+START_TEST (test_bst_build)
+{
+    static long sorted[N];
+    long x;
+    size_t i, n;
+
+    bst_free(t, NULL);
+
+    memcpy(sorted, numbers, sizeof sorted);
+    qsort(sorted, N, sizeof *sorted, cmp_long);
+    for (i = n = 0; i<N; ++i)
+    {
+        if (!n || sorted[n-1] != sorted[i])
+            sorted[n++] = sorted[i];
+    }
+
+    t = bst_build_sorted(sorted, NULL, n);
+    fail_unless(t != NULL);
+    fail_unless(bst_size(t) == n);
+    for (i=0; i<n; ++i)
+    {
+        fail_unless(bst_contains(t, sorted[i]));
+        fail_unless(bst_select(t, i, &x, NULL) == 0 && x == sorted[i]);
+    }
+
+    /* the tree is a regular bst afterwards */
+    fail_unless(bst_remove(t, sorted[n/2], NULL) == 0);
+    fail_unless(bst_size(t) == n - 1);
+    fail_unless(bst_insert(t, sorted[n/2], NULL) == 0);
+
+    /* merge a batch overlapping the tree */
+    for (i=0; i<N; ++i)
+        numbers[i] = -numbers[i];
+    fail_unless(bst_insert_many(t, numbers, NULL, N) == 0);
+    fail_unless(bst_insert_many(t, sorted, NULL, N / 100) == 0);
+    /* 0 == -0 */
+    n = 2 * n - (sorted[0] == 0);
+    fail_unless(bst_size(t) == n, "size %lu, expected %lu",
+            (unsigned long)bst_size(t), (unsigned long)n);
+    for (i=0; i<N; ++i)
+        fail_unless(bst_contains(t, numbers[i]) && bst_contains(t, -numbers[i]));
+
+    /* not sorted */
+    sorted[1] = sorted[0];
+    fail_unless(bst_build_sorted(sorted, NULL, 2) == NULL);
+}
+END_TEST
+
+START_TEST (test_bst_snapshot)
+{
+    bst *s1, *s2;
+    size_t i, n = 0;
+    long x = -1;
+
+    for (i=0; i<N; ++i)
+    {
+        if (bst_insert(t, numbers[i], &numbers[i]) == 0)
+            n++;
+    }
+
+    s1 = bst_snapshot(t);
+    fail_unless(s1 != NULL);
+    fail_unless(bst_insert(s1, -1, NULL) == -1);
+
+    /* remove the first half, insert negative numbers */
+    for (i=0; i<N/2; ++i)
+    {
+        bst_remove(t, numbers[i], NULL);
+        bst_insert(t, -numbers[i] - 1, NULL);
+    }
+    s2 = bst_snapshot(t);
+
+    fail_unless(bst_size(s1) == n);
+    fail_unless(bst_range(s1, 0, RAND_MAX, count_range, &x) == n);
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bst_get(s1, numbers[i]) == &numbers[i]);
+        fail_unless(!bst_contains(s1, -numbers[i] - 1));
+    }
+
+    bst_free(s1, NULL);
+    bst_clear(t, NULL);
+    fail_unless(bst_size(t) == 0);
+
+    for (i=0; i<N/2; ++i)
+        fail_unless(bst_contains(s2, -numbers[i] - 1));
+    fail_unless(bst_select(s2, 0, &x, NULL) == 0 && x < 0);
+    fail_unless(bst_size(s2) == bst_rank(s2, 0) + bst_range(s2, 0, RAND_MAX, NULL, NULL));
+    bst_free(s2, NULL);
+
+    /* the snapshots are reclaimed by this */
+    fail_unless(bst_insert(t, 1337, NULL) == 0);
+    fail_unless(bst_size(t) == 1);
+}
+END_TEST
+
+START_TEST (test_bst_snapshot_iter)
+{
+    bst *m, *s;
+    bstiter it;
+    long key, prev;
+    void *data;
+    size_t i, n;
+
+    m = bst_init_o(BST_MULTI);
+    for (i=0; i<1000; ++i)
+        bst_insert(m, (long)(i / 3), &numbers[i]);
+
+    s = bst_snapshot(m);
+    fail_unless(s != NULL);
+
+    /* change the tree, the snapshot's iterators must not notice */
+    for (i=0; i<1000; i += 2)
+        bst_remove(m, (long)(i / 3), NULL);
+    bst_insert(m, -1, NULL);
+
+    n = 0;
+    prev = -1;
+    bst_iter(s, &it, 0);
+    while (bstiter_next(&it, &key, NULL))
+    {
+        fail_unless(key >= prev && key >= 0);
+        prev = key;
+        n++;
+    }
+    fail_unless(n == 1000);
+
+    n = 0;
+    prev = LONG_MAX;
+    bst_iter(s, &it, 1);
+    while (bstiter_next(&it, &key, NULL))
+    {
+        fail_unless(key <= prev);
+        prev = key;
+        n++;
+    }
+    fail_unless(n == 1000);
+
+    fail_unless(bst_lower_bound(s, 300, &it) == 0);
+    fail_unless(bstiter_next(&it, &key, NULL) && key == 300);
+    fail_unless(bst_lower_bound(s, 334, &it) == -1);
+
+    n = 0;
+    fail_unless(bst_get_all(s, 100, &it) == 0);
+    while (bstiter_next(&it, &key, &data))
+    {
+        fail_unless(key == 100);
+        fail_unless((long*)data - numbers >= 300 && (long*)data - numbers <= 302);
+        n++;
+    }
+    fail_unless(n == 3);
+    fail_unless(bst_get_all(s, 334, &it) == -1);
+
+    bst_free(s, NULL);
+    bst_free(m, NULL);
+}
+END_TEST
+
+START_TEST (test_bst_split)
+{
+    bst *l, *r, *u;
+    void *data;
+    long x = -1, key = RAND_MAX / 2;
+    size_t i, n = 0, n_left;
+
+    /* empty tree */
+    fail_unless(bst_split(t, key, &l, &r) == 0);
+    fail_unless(l == t && bst_size(l) == 0 && bst_size(r) == 0);
+    fail_unless(bst_join(l, r) == 0);
+
+    for (i=0; i<N; ++i)
+    {
+        if (bst_insert(t, numbers[i], &numbers[i]) == 0)
+            n++;
+    }
+    n_left = bst_rank(t, key);
+
+    fail_unless(bst_split(t, key, &l, &r) == 0);
+    fail_unless(bst_size(l) == n_left);
+    fail_unless(bst_size(r) == n - n_left);
+    fail_unless(bst_max(l, &x, NULL) == -1 || x < key);
+    fail_unless(bst_min(r, &x, NULL) == -1 || x >= key);
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bst_get((numbers[i] < key) ? l : r, numbers[i]) == &numbers[i]);
+        fail_unless(!bst_contains((numbers[i] < key) ? r : l, numbers[i]));
+    }
+
+    /* both trees can be updated independently */
+    fail_unless(bst_insert(l, -1, NULL) == 0);
+    fail_unless(bst_min(r, &x, &data) == 0);
+    fail_unless(bst_remove(r, x, NULL) == 0);
+    fail_unless(bst_insert(r, x, data) == 0);
+    fail_unless(bst_remove(l, -1, NULL) == 0);
+
+    /* overlapping keys */
+    fail_unless(bst_join(r, l) == -1);
+
+    fail_unless(bst_join(l, r) == 0);
+    fail_unless(bst_size(t) == n);
+    x = -1;
+    fail_unless(bst_range(t, 0, RAND_MAX, count_range, &x) == n);
+
+    /* trees that differ in BST_MULTI */
+    u = bst_init_o(BST_MULTI);
+    bst_insert(u, LONG_MAX, NULL);
+    bst_insert(u, LONG_MAX, NULL);
+    fail_unless(bst_join(t, u) == -1);
+    fail_unless(bst_size(t) == n && bst_size(u) == 2);
+    bst_free(u, NULL);
+
+    /* a tree built separately */
+    u = bst_init();
+    for (i=0; i<N; ++i)
+        bst_insert(u, -numbers[i] - 1, NULL);
+    fail_unless(bst_join(u, t) == 0);
+    t = u;
+    fail_unless(bst_size(t) == 2 * n);
+    fail_unless(bst_select(t, n, &x, NULL) == 0 && x >= 0);
+}
+END_TEST
+
+START_TEST (test_bst_freeze)
+{
+    bstfrozen *f;
+    bst *u;
+    long x = -1;
+    size_t i, n = 0;
+
+    f = bst_freeze(t);
+    fail_unless(f != NULL && bsf_size(f) == 0);
+    fail_unless(!bsf_contains(f, 0));
+    fail_unless(bsf_range(f, 0, RAND_MAX, NULL, NULL) == 0);
+    bsf_free(f);
+
+    for (i=0; i<N; ++i)
+    {
+        if (bst_insert(t, numbers[i], &numbers[i]) == 0)
+            n++;
+    }
+
+    f = bst_freeze(t);
+    fail_unless(f != NULL);
+    fail_unless(bsf_size(f) == n);
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bsf_get(f, numbers[i]) == &numbers[i]);
+        fail_unless(bsf_contains(f, -numbers[i] - 1) == 0);
+    }
+    fail_unless(!bsf_contains(f, 1337));
+    fail_unless(bsf_range(f, 0, RAND_MAX, count_range, &x) == n);
+    fail_unless(bsf_range(f, 0, numbers[0], NULL, NULL) == bst_rank(t, numbers[0]) + 1);
+    fail_unless(bsf_range(f, numbers[0] + 1, numbers[0], NULL, NULL) == 0);
+
+    u = bst_thaw(f);
+    bsf_free(f);
+    fail_unless(u != NULL);
+    fail_unless(bst_size(u) == n);
+    for (i=0; i<N; ++i)
+        fail_unless(bst_get(u, numbers[i]) == &numbers[i]);
+    fail_unless(bst_insert(u, 1337, NULL) == 0);
+    bst_free(u, NULL);
+}
+END_TEST
+
+START_TEST (test_bst_multi)
+{
+    bstiter it;
+    long x;
+    void *data;
+    size_t i, n;
+
+    bst_free(t, NULL);
+    t = bst_init_o(BST_MULTI);
+
+    /* every number three times, with different data */
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(bst_insert(t, numbers[i], &numbers[i]) == 0);
+        fail_unless(bst_insert(t, numbers[i], NULL) == 0);
+    }
+    fail_unless(bst_insert_many(t, numbers, NULL, N) == 0);
+    fail_unless(bst_size(t) == 3 * N);
+
+    for (i=0; i<N; ++i)
+    {
+        n = bst_count(t, numbers[i]);
+        fail_unless(n >= 3 && n % 3 == 0);
+        data = bst_get(t, numbers[i]);
+        fail_unless(data != NULL && *(long*)data == numbers[i]);
+    }
+    fail_unless(bst_count(t, 1337) == 0);
+    fail_unless(bst_get_all(t, 1337, &it) == -1);
+    fail_unless(!bstiter_next(&it, NULL, NULL));
+
+    /* equal keys are returned in insertion order */
+    fail_unless(bst_get_all(t, numbers[0], &it) == 0);
+    fail_unless(bstiter_next(&it, &x, &data) && data == &numbers[0]);
+    fail_unless(bstiter_next(&it, &x, &data) && data == NULL);
+    for (n = 2; bstiter_next(&it, &x, NULL); n++)
+        fail_unless(x == numbers[0]);
+    fail_unless(n == bst_count(t, numbers[0]));
+
+    /* remove a specific item */
+    fail_unless(bst_remove_data(t, numbers[0], &x, NULL) == -1);
+    fail_unless(bst_remove_data(t, numbers[0], NULL, NULL) == 0);
+    fail_unless(bst_count(t, numbers[0]) == n - 1);
+    fail_unless(bst_get(t, numbers[0]) == &numbers[0]);
+    fail_unless(bst_remove(t, numbers[0], NULL) == 0);
+    fail_unless(bst_count(t, numbers[0]) == n - 2);
+    fail_unless(bst_get(t, numbers[0]) != &numbers[0]);
+
+    /* ordered operations see all of them */
+    fail_unless(bst_range(t, 0, RAND_MAX, NULL, NULL) == 3 * N - 2);
+    fail_unless(bst_select(t, bst_rank(t, numbers[1]), &x, NULL) == 0);
+    fail_unless(x == numbers[1]);
+}
+END_TEST
+
+static long number_value(long key, void *data)
+{
+    return *(long*)data % 1000;
+}
+
+static void sum_range(long key, void *data, void *arg)
+{
+    long *sum = arg;
+    *sum += number_value(key, data);
+}
+
+START_TEST (test_bst_aggregate)
+{
+    long lo, hi, sum, max;
+    size_t i, j;
+
+    for (i=0; i<N/2; ++i)
+        bst_insert(t, numbers[i], &numbers[i]);
+
+    fail_unless(bst_aggregate(t, 0, RAND_MAX) == 0);
+    fail_unless(bst_augment(t, &bstmonoid_sum, number_value) == 0);
+
+    /* kept up to date by further updates */
+    for (i=N/2; i<N; ++i)
+        bst_insert(t, numbers[i], &numbers[i]);
+    for (i=0; i<N/4; ++i)
+        bst_remove(t, numbers[i], NULL);
+
+    for (i=0; i<100; ++i)
+    {
+        lo = numbers[rand() % N];
+        hi = numbers[rand() % N];
+        sum = 0;
+        bst_range(t, lo, hi, sum_range, &sum);
+        fail_unless(bst_aggregate(t, lo, hi) == sum);
+    }
+    fail_unless(bst_aggregate(t, 1, 0) == 0);
+
+    fail_unless(bst_augment(t, &bstmonoid_max, number_value) == 0);
+    max = bst_aggregate(t, 0, RAND_MAX);
+    for (i = j = 0; i<N; ++i)
+    {
+        if (bst_contains(t, numbers[i]))
+        {
+            fail_unless(number_value(0, &numbers[i]) <= max);
+            j += (number_value(0, &numbers[i]) == max);
+        }
+    }
+    fail_unless(j > 0);
+    fail_unless(bst_aggregate(t, 1, 0) == LONG_MIN);
+
+    /* counting */
+    sum = -1;
+    fail_unless(bst_range(t, lo, hi, NULL, NULL) ==
+            bst_range(t, lo, hi, count_range, &sum));
+}
+END_TEST
+
+START_TEST (test_bst_get_many)
+{
+    static long keys[N + 1];
+    static void *out[N + 1];
+    size_t i, n;
+
+    for (i=0; i<N/2; ++i)
+        bst_insert(t, numbers[i], &numbers[i]);
+
+    /* unsorted, with a missing key */
+    memcpy(keys, numbers, sizeof numbers);
+    keys[N] = 1337;
+    n = bst_get_many(t, keys, N + 1, out);
+    for (i=0; i<=N; ++i)
+    {
+        fail_unless(out[i] == bst_get(t, keys[i]));
+        n -= bst_contains(t, keys[i]);
+    }
+    fail_unless(n == 0);
+
+    /* sorted */
+    qsort(keys, N + 1, sizeof *keys, cmp_long);
+    n = bst_get_many(t, keys, N + 1, out);
+    for (i=0; i<=N; ++i)
+    {
+        fail_unless(out[i] == bst_get(t, keys[i]));
+        n -= bst_contains(t, keys[i]);
+    }
+    fail_unless(n == 0);
+
+    /* the first of equal items */
+    bst_free(t, NULL);
+    t = bst_init_o(BST_MULTI);
+    for (i=0; i<N; ++i)
+    {
+        bst_insert(t, numbers[i], NULL);
+        bst_insert(t, numbers[i], &numbers[i]);
+    }
+    fail_unless(bst_get_many(t, keys, N + 1, out) == N);
+    for (i=0; i<=N; ++i)
+        fail_unless(out[i] == bst_get(t, keys[i]));
+}
+END_TEST
+
+static void encode_negated(long key, void *data, void *rec)
+{
+    long x = -*(long*)data;
+    memcpy(rec, &x, sizeof x);
+}
+
+START_TEST (test_bst_save)
+{
+    const char *path = "test_bst.bsf";
+    bstfrozen *f;
+    bst *u;
+    FILE *fp;
+    long x = -1, *rec;
+    size_t i;
+
+    for (i=0; i<N; ++i)
+        bst_insert(t, numbers[i], &numbers[i]);
+
+    /* records copied from the data */
+    fail_unless(bst_save(t, path, sizeof(long), NULL) == 0);
+    f = bst_open_mmap(path);
+    fail_unless(f != NULL);
+    fail_unless(bsf_size(f) == bst_size(t));
+    for (i=0; i<N; ++i)
+    {
+        rec = bsf_get(f, numbers[i]);
+        fail_unless(rec != NULL && *rec == numbers[i]);
+    }
+    fail_unless(!bsf_contains(f, 1337));
+    fail_unless(bsf_range(f, 0, RAND_MAX, count_range, &x) == bst_size(t));
+
+    u = bst_thaw(f);
+    fail_unless(u != NULL && bst_size(u) == bst_size(t));
+    x = -1;
+    fail_unless(bst_range(u, 0, RAND_MAX, count_range, &x) == bst_size(t));
+    bst_free(u, NULL);
+    bsf_free(f);
+
+    /* encoded records */
+    fail_unless(bst_save(t, path, sizeof(long), encode_negated) == 0);
+    f = bst_open_mmap(path);
+    fail_unless(f != NULL);
+    rec = bsf_get(f, numbers[0]);
+    fail_unless(rec != NULL && *rec == -numbers[0]);
+    bsf_free(f);
+
+    /* keys only */
+    bst_clear(t, NULL);
+    bst_insert(t, 1, &x);
+    fail_unless(bst_save(t, path, 0, NULL) == 0);
+    f = bst_open_mmap(path);
+    fail_unless(f != NULL && bsf_size(f) == 1);
+    fail_unless(bsf_contains(f, 1) && bsf_get(f, 1) == NULL);
+    bsf_free(f);
+
+    /* not a saved tree */
+    fp = fopen(path, "wb");
+    fail_unless(fp != NULL);
+    for (i=0; i<N; ++i)
+        fputc(i, fp);
+    fclose(fp);
+    fail_unless(bst_open_mmap(path) == NULL);
+
+    remove(path);
+    fail_unless(bst_open_mmap(path) == NULL);
+}
+END_TEST
+
 Suite *bst_suite(void)
 {
     Suite *s = suite_create("testing a bunch of numbers");
@@ -101,6 +721,17 @@ Suite *bst_suite(void)
     tcase_add_checked_fixture (tc_simple, setup, teardown);
 
     tcase_add_test(tc_simple, test_bst);
+    tcase_add_test(tc_simple, test_bst_order);
+    tcase_add_test(tc_simple, test_bst_rank);
+    tcase_add_test(tc_simple, test_bst_build);
+    tcase_add_test(tc_simple, test_bst_snapshot);
+    tcase_add_test(tc_simple, test_bst_snapshot_iter);
+    tcase_add_test(tc_simple, test_bst_split);
+    tcase_add_test(tc_simple, test_bst_freeze);
+    tcase_add_test(tc_simple, test_bst_multi);
+    tcase_add_test(tc_simple, test_bst_aggregate);
+    tcase_add_test(tc_simple, test_bst_get_many);
+    tcase_add_test(tc_simple, test_bst_save);
 
     suite_add_tcase(s, tc_simple);
 
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <check.h>
+
+#include "cskiplist.h"
+
+#define N 10000
+#define THREADS 4
+
+cskiplist *l;
+long numbers[N];
+
+
+static void setup(void)
+{
+    size_t i, j;
+    long x;
+
+    l = csl_init();
+
+    srand(time(NULL));
+
+    /* unique numbers in random order */
+    for (i=0; i<N; ++i)
+        numbers[i] = i * 3;
+    for (i=N-1; i>0; --i)
+    {
+        j = rand() % (i + 1);
+        x = numbers[i], numbers[i] = numbers[j], numbers[j] = x;
+    }
+}
+
+static void teardown(void)
+{
+    csl_free(l, NULL);
+}
+
+static void count_range(long key, void *data, void *arg)
+{
+    long *last = arg;
+    fail_unless(*(long*)data == key);
+    fail_unless(key > *last);
+    *last = key;
+}
+
+/* every thread inserts and removes its own share of numbers */
+static void *worker(void *arg)
+{
+    size_t i, id = (size_t)arg;
+    long failed = 0;
+
+    for (i=id; i<N; i+=THREADS)
+        failed += (csl_insert(l, numbers[i], &numbers[i]) != 0);
+
+    for (i=id; i<N; i+=THREADS)
+    {
+        if (!csl_contains(l, numbers[i]) || csl_get(l, numbers[i]) != &numbers[i])
+            failed++;
+
+        /* remove every other number */
+        if (i % 2)
+            failed += (csl_remove(l, numbers[i], NULL) != 0);
+    }
+    return (void*)failed;
+}
+
+START_TEST (test_csl)
+{
+    size_t i;
+    long x;
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(csl_insert(l, numbers[i], &numbers[i]) == 0);
+        fail_unless(csl_contains(l, numbers[i]),
+                "failed assertion: csl_contains(l, %ld)\n", numbers[i]);
+    }
+    fail_unless(csl_insert(l, numbers[0], NULL) == -1);
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(csl_get(l, numbers[i]) == &numbers[i]);
+        fail_unless(!csl_contains(l, numbers[i] + 1));
+    }
+
+    x = -1;
+    fail_unless(csl_range(l, 0, 3 * N, count_range, &x) == N);
+    x = 99;
+    fail_unless(csl_range(l, 100, 200, count_range, &x) == 33);
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(csl_remove(l, numbers[i], NULL) == 0);
+        fail_unless(!csl_contains(l, numbers[i]),
+                "failed assertion: !csl_contains(l, %ld)\n", numbers[i]);
+    }
+    fail_unless(csl_remove(l, numbers[0], NULL) == -1);
+    fail_unless(csl_range(l, 0, 3 * N, NULL, NULL) == 0);
+}
+END_TEST
+
+START_TEST (test_csl_threads)
+{
+    pthread_t threads[THREADS];
+    void *failed;
+    size_t i;
+    long x;
+
+    for (i=0; i<THREADS; ++i)
+        fail_unless(pthread_create(&threads[i], NULL, worker, (void*)i) == 0);
+
+    for (i=0; i<THREADS; ++i)
+    {
+        pthread_join(threads[i], &failed);
+        fail_unless(failed == NULL, "thread %lu: %ld failures",
+                (unsigned long)i, (long)failed);
+    }
+
+    for (i=0; i<N; ++i)
+        fail_unless(csl_contains(l, numbers[i]) == !(i % 2));
+
+    x = -1;
+    fail_unless(csl_range(l, 0, 3 * N, count_range, &x) == N / 2);
+}
+END_TEST
+
+Suite *csl_suite(void)
+{
+    Suite *s = suite_create("concurrent skip list");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_csl);
+    tcase_add_test(tc_simple, test_csl_threads);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, csl_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <check.h>
+
+#include "gbst.h"
+
+/* composite key, compared inline */
+struct tskey
+{
+    int tenant;
+    long time;
+};
+
+#define BSTG_NAME tsmap
+#define BSTG_KEY struct tskey
+#define BSTG_CMP(t, a, b) (((a).tenant != (b).tenant) ? \
+        ((a).tenant > (b).tenant) - ((a).tenant < (b).tenant) : \
+        ((a).time > (b).time) - ((a).time < (b).time))
+#define BSTG_SCOPE static
+#define BSTG_IMPLEMENT
+#include "bstgen.h"
+
+#define N 10000
+
+gbst *t;
+long numbers[N];
+char strings[N][16];
+
+
+static int cmp_string(const void *a, const void *b, const void *arg)
+{
+    (void)arg;
+    return strcmp(a, b);
+}
+
+static void setup(void)
+{
+    size_t i, j;
+    long x;
+
+    t = gbst_init(cmp_string, NULL);
+
+    srand(time(NULL));
+
+    /* unique numbers in random order */
+    for (i=0; i<N; ++i)
+        numbers[i] = i * 3;
+    for (i=N-1; i>0; --i)
+    {
+        j = rand() % (i + 1);
+        x = numbers[i], numbers[i] = numbers[j], numbers[j] = x;
+    }
+
+    for (i=0; i<N; ++i)
+        sprintf(strings[i], "%08ld", numbers[i]);
+}
+
+static void teardown(void)
+{
+    gbst_free(t, NULL);
+}
+
+static void count_strings(const void *key, void *data, void *arg)
+{
+    const char **last = arg;
+    fail_unless(*last == NULL || strcmp(*last, key) < 0);
+    fail_unless(strcmp(key, data) == 0);
+    *last = key;
+}
+
+static void count_ts(struct tskey key, void *data, void *arg)
+{
+    long *n = arg;
+    fail_unless(key.tenant == 1);
+    fail_unless(*(long*)data == key.time);
+    (*n)++;
+}
+
+START_TEST (test_gbst)
+{
+    const char *last = NULL;
+    const void *key;
+    size_t i;
+
+    for (i=0; i<N; ++i)
+    {
+        fail_unless(gbst_insert(t, strings[i], strings[i]) == 0);
+        fail_unless(gbst_contains(t, strings[i]));
+    }
+    fail_unless(gbst_insert(t, strings[0], NULL) == -1);
+    fail_unless(gbst_size(t) == N);
+
+    fail_unless(gbst_min(t, &key, NULL) == 0 && strcmp(key, "00000000") == 0);
+    fail_unless(gbst_range(t, "", "~", count_strings, &last) == N);
+    fail_unless(gbst_range(t, "00000001", "00000005", NULL, NULL) == 1);
+
+    for (i=0; i<N/2; ++i)
+    {
+        fail_unless(gbst_remove(t, strings[i], NULL) == 0);
+        fail_unless(!gbst_contains(t, strings[i]));
+    }
+    fail_unless(gbst_remove(t, strings[0], NULL) == -1);
+    fail_unless(gbst_size(t) == N - N/2);
+
+    for (i=N/2; i<N; ++i)
+        fail_unless(gbst_get(t, strings[i]) == strings[i]);
+}
+END_TEST
+
+START_TEST (test_gbst_composite)
+{
+    tsmap *m = tsmap_init();
+    struct tskey k, lo, hi;
+    long n = 0;
+    size_t i;
+
+    /* the same times for two tenants */
+    for (i=0; i<N; ++i)
+    {
+        k.time = numbers[i];
+        k.tenant = 1;
+        fail_unless(tsmap_insert(m, k, &numbers[i]) == 0);
+        k.tenant = 2;
+        fail_unless(tsmap_insert(m, k, NULL) == 0);
+    }
+    fail_unless(tsmap_size(m) == 2 * N);
+    fail_unless(tsmap_insert(m, k, NULL) == -1);
+
+    lo.tenant = hi.tenant = 1;
+    lo.time = 0;
+    hi.time = 3 * N;
+    fail_unless(tsmap_range(m, lo, hi, count_ts, &n) == N);
+    fail_unless(n == N);
+
+    for (i=0; i<N; ++i)
+    {
+        k.time = numbers[i];
+        k.tenant = 2;
+        fail_unless(tsmap_remove(m, k, NULL) == 0);
+        k.tenant = 1;
+        fail_unless(tsmap_get(m, k) == &numbers[i]);
+    }
+    fail_unless(tsmap_max(m, &k, NULL) == 0 && k.tenant == 1);
+
+    tsmap_free(m, NULL);
+}
+END_TEST
+
+Suite *gbst_suite(void)
+{
+    Suite *s = suite_create("generic bst");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_gbst);
+    tcase_add_test(tc_simple, test_gbst_composite);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, gbst_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -4,6 +4,8 @@
 Suite *ht_init_suite(void);
 Suite *ht_simple_suite(void);
 Suite *ht_args_suite(void);
+Suite *ht_multi_suite(void);
+Suite *ht_cuckoo_suite(void);
 
 int main(void)
 {
@@ -13,6 +15,8 @@ int main(void)
     srunner_add_suite(sr, ht_init_suite());
     srunner_add_suite(sr, ht_simple_suite());
     srunner_add_suite(sr, ht_args_suite());
+    srunner_add_suite(sr, ht_multi_suite());
+    srunner_add_suite(sr, ht_cuckoo_suite());
 
     srunner_run_all(sr, CK_NORMAL);
 
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include "hashtable.h"
+
+#define N 20000
+
+hashtable *ht;
+static char keys[N][8];
+
+static void setup(void)
+{
+    size_t i;
+
+    ht_init_o(&ht, NULL, NULL, HT_CUCKOO);
+
+    for (i = 0; i < N; i++)
+        sprintf(keys[i], "%lu", (unsigned long)i);
+}
+
+static void teardown(void)
+{
+    ht_free(ht);
+}
+
+START_TEST (test_ht_cuckoo_init)
+{
+    hashtable *t;
+    int res;
+
+    res = ht_init_o(&t, NULL, NULL, HT_CUCKOO | HT_MULTI);
+    fail_unless(res == HT_ERROR && t == NULL,
+        "HT_CUCKOO can't be combined with HT_MULTI");
+}
+END_TEST
+
+START_TEST (test_ht_cuckoo_insert)
+{
+    int res, data1, data2;
+    size_t i;
+
+    res = ht_insert(ht, "test", &data1);
+    fail_unless(res == HT_OK,
+        "inserting a new item should return HT_OK");
+
+    res = ht_insert(ht, "test", &data2);
+    fail_unless(res == HT_EXIST,
+        "re-inserting an item should return HT_EXIST");
+
+    fail_unless(ht_get(ht, "test") == &data1,
+        "ht_get() should return the data set by the first ht_insert() call");
+
+    for (i = 0; i < N; i++)
+    {
+        res = ht_insert(ht, keys[i], keys[i]);
+        fail_unless(res == HT_OK,
+            "inserting a new item should return HT_OK");
+    }
+
+    for (i = 0; i < N; i++)
+    {
+        fail_unless(ht_get(ht, keys[i]) == keys[i],
+            "ht_get() should return the inserted data after growing the table");
+    }
+}
+END_TEST
+
+START_TEST (test_ht_cuckoo_remove)
+{
+    size_t i;
+
+    for (i = 0; i < N; i++)
+        ht_insert(ht, keys[i], keys[i]);
+
+    for (i = 0; i < N; i += 2)
+    {
+        fail_unless(ht_remove(ht, keys[i]) == keys[i],
+            "ht_remove() should return the data associated with the given key");
+    }
+
+    for (i = 0; i < N; i++)
+    {
+        fail_unless(ht_get(ht, keys[i]) == ((i % 2) ? keys[i] : NULL),
+            "only removed items should no longer be returned by ht_get()");
+    }
+
+    for (i = 1; i < N; i += 2)
+        ht_remove(ht, keys[i]);
+
+    fail_unless(ht_empty(ht));
+}
+END_TEST
+
+static hash_t const_hash(const void *key, const void *arg)
+{
+    (void)key;
+    (void)arg;
+    return 42;
+}
+
+static int str_cmp(const void *a, const void *b, const void *arg)
+{
+    (void)arg;
+    return strcmp(a, b);
+}
+
+START_TEST (test_ht_cuckoo_same_hash)
+{
+    hashtable *t;
+    size_t i, n = 0;
+
+    ht_init_o(&t, const_hash, str_cmp, HT_CUCKOO);
+
+    /* the table can't grow its way out of this, so inserting must fail
+     * soon instead of doubling the table until memory runs out */
+    for (i = 0; i < 100; i++)
+    {
+        if (ht_insert(t, keys[i], keys[i]) != HT_OK)
+            break;
+        n++;
+    }
+    fail_unless(n >= 10 && n < 100,
+        "inserting too many keys with equal hash should return HT_ERROR");
+
+    for (i = 0; i < n; i++)
+        fail_unless(ht_get(t, keys[i]) == keys[i]);
+    fail_unless(ht_get(t, keys[n]) == NULL);
+
+    ht_free(t);
+}
+END_TEST
+
+START_TEST (test_ht_cuckoo_iter)
+{
+    htiter *it;
+    void *key, *data;
+    size_t i, n = 0;
+
+    for (i = 0; i < N; i++)
+        ht_insert(ht, keys[i], keys[i]);
+
+    it = ht_iter(ht);
+    while (htiter_next(it, &key, &data))
+    {
+        fail_unless(key == data);
+        n++;
+    }
+    free(it);
+
+    fail_unless(n == N,
+        "iterating should return all items");
+}
+END_TEST
+
+Suite *ht_cuckoo_suite(void)
+{
+    Suite *s = suite_create("hashtable with cuckoo hashing");
+
+    TCase *tc_cuckoo = tcase_create("cuckoo");
+
+    tcase_add_checked_fixture (tc_cuckoo, setup, teardown);
+
+    tcase_add_test(tc_cuckoo, test_ht_cuckoo_init);
+    tcase_add_test(tc_cuckoo, test_ht_cuckoo_insert);
+    tcase_add_test(tc_cuckoo, test_ht_cuckoo_remove);
+    tcase_add_test(tc_cuckoo, test_ht_cuckoo_same_hash);
+    tcase_add_test(tc_cuckoo, test_ht_cuckoo_iter);
+
+    suite_add_tcase(s, tc_cuckoo);
+
+    return s;
+}
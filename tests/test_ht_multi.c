@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <check.h>
+#include "hashtable.h"
+
+
+hashtable *ht;
+
+static void setup(void)
+{
+    ht_init_o(&ht, NULL, NULL, HT_MULTI);
+}
+
+static void teardown(void)
+{
+    ht_free(ht);
+}
+
+START_TEST (test_ht_multi_insert)
+{
+    int res, data1, data2;
+    int *p;
+
+    res = ht_insert(ht, "test", &data1);
+    fail_unless(res == HT_OK,
+        "inserting a new item should return HT_OK");
+
+    res = ht_insert(ht, "test", &data2);
+    fail_unless(res == HT_OK,
+        "re-inserting an item in multimap mode should return HT_OK");
+
+    p = ht_get(ht, "test");
+    fail_unless(p == &data1,
+        "ht_get() should return the data inserted first");
+
+    fail_unless(ht_count(ht, "test") == 2,
+        "ht_count() should return the number of items with equal key");
+    fail_unless(ht_count(ht, "foo") == 0,
+        "ht_count() should return 0 for a non-existent key");
+}
+END_TEST
+
+START_TEST (test_ht_multi_get_all)
+{
+    int data[4], i;
+    int *p;
+    void *key;
+    htiter *it;
+
+    ht_insert(ht, "test", &data[0]);
+    ht_insert(ht, "foo", &data[3]);
+    ht_insert(ht, "test", &data[1]);
+    ht_insert(ht, "test", &data[2]);
+
+    it = ht_get_all(ht, "test");
+    fail_unless(it != NULL);
+
+    for (i = 0; htiter_next(it, &key, (void**)&p); i++)
+    {
+        fail_unless(p == &data[i],
+            "ht_get_all() should return all items in insertion order");
+    }
+    fail_unless(i == 3,
+        "ht_get_all() should return all items with equal key");
+    free(it);
+
+    it = ht_get_all(ht, "bar");
+    fail_unless(!htiter_next(it, NULL, NULL),
+        "ht_get_all() should return no items for a non-existent key");
+    free(it);
+}
+END_TEST
+
+START_TEST (test_ht_multi_remove_all)
+{
+    int data1, data2;
+    size_t n;
+
+    ht_insert(ht, "test", &data1);
+    ht_insert(ht, "test", &data2);
+    ht_insert(ht, "foo", &data1);
+
+    n = ht_remove_all(ht, "test");
+    fail_unless(n == 2,
+        "ht_remove_all() should return the number of removed items");
+    fail_unless(ht_get(ht, "test") == NULL,
+        "removed items should no longer be returned by ht_get()");
+    fail_unless(ht_get(ht, "foo") == &data1,
+        "items with another key should not be removed");
+}
+END_TEST
+
+START_TEST (test_ht_multi_resize)
+{
+    static char keys[5000][8];
+    int data;
+    size_t i;
+
+    for (i = 0; i < 5000; i++)
+    {
+        sprintf(keys[i], "%lu", (unsigned long)(i % 1000));
+        ht_insert(ht, keys[i], &data);
+    }
+
+    for (i = 0; i < 1000; i++)
+    {
+        fail_unless(ht_count(ht, keys[i]) == 5,
+            "equal keys should stay together after resizing");
+    }
+}
+END_TEST
+
+Suite *ht_multi_suite(void)
+{
+    Suite *s = suite_create("hashtable in multimap mode");
+
+    TCase *tc_multi = tcase_create("multi");
+
+    tcase_add_checked_fixture (tc_multi, setup, teardown);
+
+    tcase_add_test(tc_multi, test_ht_multi_insert);
+    tcase_add_test(tc_multi, test_ht_multi_get_all);
+    tcase_add_test(tc_multi, test_ht_multi_remove_all);
+    tcase_add_test(tc_multi, test_ht_multi_resize);
+
+    suite_add_tcase(s, tc_multi);
+
+    return s;
+}
@@ -1,6 +1,8 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <check.h>
 #include "hashtable.h"
+#include "htfilter.h"
 
 
 hashtable *ht;
@@ -146,6 +148,165 @@ START_TEST (test_ht_remove_nonexistent)
 }
 END_TEST
 
+START_TEST (test_ht_clear)
+{
+    int data;
+
+    ht_insert(ht, "foo", &data);
+    ht_insert(ht, "bar", &data);
+    ht_clear(ht);
+    fail_unless(ht_empty(ht),
+        "after ht_clear() the hashtable should be empty");
+
+    fail_unless(ht_get(ht, "foo") == NULL,
+        "cleared items should no longer be returned by ht_get()");
+
+    fail_unless(ht_insert(ht, "foo", &data) == HT_OK,
+        "inserting into a cleared hashtable should return HT_OK");
+    fail_unless(ht_get(ht, "foo") == &data,
+        "ht_get() should return the data inserted after ht_clear()");
+}
+END_TEST
+
+START_TEST (test_ht_noshrink)
+{
+    static char keys[5000][8];
+    hashtable *t;
+    int n_items, n_buckets, n_buckets_full, empty, one, gtone, max;
+    double avg;
+    size_t i;
+
+    ht_init_o(&t, NULL, NULL, HT_NOSHRINK);
+
+    for (i = 0; i < 5000; i++)
+    {
+        sprintf(keys[i], "%lu", (unsigned long)i);
+        ht_insert(t, keys[i], keys[i]);
+    }
+    ht_statistics(t, &n_items, &n_buckets_full, &empty, &one, &gtone, &max, &avg);
+
+    for (i = 0; i < 5000; i++)
+        ht_remove(t, keys[i]);
+    ht_statistics(t, &n_items, &n_buckets, &empty, &one, &gtone, &max, &avg);
+
+    fail_unless(n_items == 0 && n_buckets == n_buckets_full,
+        "removing items with HT_NOSHRINK should not shrink the hashtable");
+
+    ht_free(t);
+}
+END_TEST
+
+START_TEST (test_ht_small)
+{
+    static char keys[100][8];
+    hashtable *t;
+    size_t i, j;
+
+    ht_init_o(&t, NULL, NULL, HT_SMALL);
+
+    for (i = 0; i < 100; i++)
+    {
+        sprintf(keys[i], "%lu", (unsigned long)i);
+        fail_unless(ht_insert(t, keys[i], keys[i]) == HT_OK,
+            "inserting into a small hashtable should return HT_OK");
+
+        /* all items must survive leaving the inline storage */
+        for (j = 0; j <= i; j++)
+        {
+            fail_unless(ht_get(t, keys[j]) == keys[j],
+                "ht_get() should return the data inserted into a small hashtable");
+        }
+    }
+
+    for (i = 0; i < 100; i++)
+        fail_unless(ht_remove(t, keys[i]) == keys[i]);
+    fail_unless(ht_empty(t));
+
+    ht_free(t);
+}
+END_TEST
+
+START_TEST (test_ht_small_shrink)
+{
+    static char keys[5000][8];
+    hashtable *t;
+    size_t i;
+
+    ht_init_o(&t, NULL, NULL, HT_SMALL);
+
+    /* shrinking trims the item pool, the inline items must stay usable */
+    for (i = 0; i < 5000; i++)
+    {
+        sprintf(keys[i], "%lu", (unsigned long)i);
+        ht_insert(t, keys[i], keys[i]);
+    }
+    for (i = 0; i < 4990; i++)
+        fail_unless(ht_remove(t, keys[i]) == keys[i]);
+    for (i = 0; i < 5000; i += 2)
+        ht_insert(t, keys[i], keys[i]);
+
+    for (i = 0; i < 5000; i++)
+    {
+        fail_unless(ht_get(t, keys[i]) == ((i % 2 && i < 4990) ? NULL : keys[i]),
+            "ht_get() should return the data inserted after shrinking");
+    }
+
+    ht_free(t);
+}
+END_TEST
+
+START_TEST (test_ht_filter)
+{
+    static char keys[5000][8];
+    size_t i;
+
+    for (i = 0; i < 5000; i++)
+        sprintf(keys[i], "%lu", (unsigned long)i);
+
+    ht_insert(ht, keys[0], keys[0]);
+    fail_unless(ht_filter(ht, 0.01) == HT_OK);
+
+    for (i = 1; i < 5000; i++)
+        ht_insert(ht, keys[i], keys[i]);
+
+    for (i = 0; i < 5000; i += 2)
+        ht_remove(ht, keys[i]);
+
+    for (i = 0; i < 5000; i++)
+    {
+        fail_unless(ht_get(ht, keys[i]) == ((i % 2) ? keys[i] : NULL),
+            "a hashtable with filter should return the same data as without");
+    }
+}
+END_TEST
+
+START_TEST (test_htf_fp_rate)
+{
+    htfilter *f;
+    hash_t h;
+    size_t fp = 0;
+
+    f = htf_init(10000, 0.01);
+
+    for (h = 0; h < 10000; h++)
+        htf_add(f, h * 2654435761U);
+
+    for (h = 0; h < 10000; h++)
+    {
+        fail_unless(htf_contains(f, h * 2654435761U),
+            "added hashes must always be found");
+    }
+
+    for (h = 10000; h < 110000; h++)
+        fp += htf_contains(f, h * 2654435761U);
+
+    fail_unless(fp < 2000,
+        "false positive rate should be close to the requested one");
+
+    htf_free(f);
+}
+END_TEST
+
 Suite *ht_simple_suite(void)
 {
     Suite *s = suite_create("hashtable operations with small amounts of (static) data");
@@ -162,6 +323,12 @@ Suite *ht_simple_suite(void)
     tcase_add_test(tc_simple, test_ht_set_twice);
     tcase_add_test(tc_simple, test_ht_get_nonexistent);
     tcase_add_test(tc_simple, test_ht_remove_nonexistent);
+    tcase_add_test(tc_simple, test_ht_clear);
+    tcase_add_test(tc_simple, test_ht_noshrink);
+    tcase_add_test(tc_simple, test_ht_small);
+    tcase_add_test(tc_simple, test_ht_small_shrink);
+    tcase_add_test(tc_simple, test_ht_filter);
+    tcase_add_test(tc_simple, test_htf_fp_rate);
 
     suite_add_tcase(s, tc_simple);
 
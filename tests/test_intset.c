@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <check.h>
+
+#include "intset.h"
+
+/* keys are taken from clusters of different density, which spread over
+ * more than one container */
+#define CLUSTERS 6
+#define WIDTH 70000
+#define U (CLUSTERS * WIDTH)
+
+intset *s;
+char ref[U];
+
+
+static long key_at(size_t i)
+{
+    return ((long)(i / WIDTH) - CLUSTERS / 2) * 1000000 + i % WIDTH;
+}
+
+/* per mille of a cluster's keys in the set; cluster 5 is made of runs */
+static int density(size_t i)
+{
+    static const int d[CLUSTERS] = { 5, 100, 500, 950, 1000, -1 };
+    return d[i / WIDTH];
+}
+
+static void setup(void)
+{
+    size_t i;
+    int d;
+
+    s = intset_init();
+
+    srand(time(NULL));
+
+    for (i=0; i<U; ++i)
+    {
+        d = density(i);
+        if (d < 0)
+            ref[i] = (i % WIDTH / 500 % 2 == 0);
+        else
+            ref[i] = (rand() % 1000 < d);
+    }
+}
+
+static void teardown(void)
+{
+    intset_free(s);
+}
+
+static void count_keys(long key, void *arg)
+{
+    long *last = arg;
+    fail_unless(key > *last);
+    *last = key;
+}
+
+static void check_set(intset *t, const char *r)
+{
+    size_t i, n = 0;
+    long last = LONG_MIN;
+
+    for (i=0; i<U; ++i)
+    {
+        fail_unless(!intset_contains(t, key_at(i)) == !r[i]);
+        if (i % 9973 == 0)
+            fail_unless(intset_rank(t, key_at(i)) == n);
+        n += r[i];
+    }
+    fail_unless(intset_size(t) == n);
+    fail_unless(intset_range(t, LONG_MIN, LONG_MAX, count_keys, &last) == n);
+    fail_unless(intset_range(t, LONG_MIN, LONG_MAX, NULL, NULL) == n);
+}
+
+START_TEST (test_intset)
+{
+    size_t i;
+
+    for (i=0; i<U; ++i)
+    {
+        if (ref[i])
+            fail_unless(intset_insert(s, key_at(i)) == 0);
+    }
+    fail_unless(intset_insert(s, key_at(U / 2)) == -1 || !ref[U / 2]);
+    check_set(s, ref);
+
+    /* keys of a window */
+    fail_unless(intset_range(s, key_at(WIDTH + 10), key_at(WIDTH + 20), NULL, NULL) ==
+            intset_rank(s, key_at(WIDTH + 21)) - intset_rank(s, key_at(WIDTH + 10)));
+
+    /* the same with runs */
+    intset_optimize(s);
+    check_set(s, ref);
+
+    /* remove every third key, inserting the others again */
+    for (i=0; i<U; i+=3)
+    {
+        fail_unless(intset_remove(s, key_at(i)) == (ref[i] ? 0 : -1));
+        ref[i] = 0;
+    }
+    for (i=1; i<U; i+=3)
+    {
+        fail_unless(intset_insert(s, key_at(i)) == (ref[i] ? -1 : 0));
+        ref[i] = 1;
+    }
+    check_set(s, ref);
+
+    /* the extremes */
+    fail_unless(intset_insert(s, LONG_MIN) == 0);
+    fail_unless(intset_insert(s, LONG_MAX) == 0);
+    fail_unless(intset_rank(s, LONG_MIN + 1) == 1);
+    fail_unless(intset_rank(s, LONG_MAX) == intset_size(s) - 1);
+    fail_unless(intset_remove(s, LONG_MIN) == 0);
+    fail_unless(intset_remove(s, LONG_MAX) == 0);
+    fail_unless(!intset_contains(s, LONG_MIN));
+
+    intset_clear(s);
+    fail_unless(intset_size(s) == 0);
+    fail_unless(intset_range(s, LONG_MIN, LONG_MAX, NULL, NULL) == 0);
+}
+END_TEST
+
+START_TEST (test_intset_ops)
+{
+    static char other[U], res[U];
+    intset *t, *u;
+    size_t i;
+
+    t = intset_init();
+    for (i=0; i<U; ++i)
+    {
+        /* a different mix of containers */
+        other[i] = (i % WIDTH < WIDTH / 2) ? (rand() % 8 == 0) : (i % 7 != 0);
+        if (other[i])
+            intset_insert(t, key_at(i));
+        if (ref[i])
+            intset_insert(s, key_at(i));
+    }
+
+    for (i=0; i<U; ++i)
+        res[i] = ref[i] || other[i];
+    u = intset_union(s, t);
+    fail_unless(u != NULL);
+    check_set(u, res);
+    intset_free(u);
+
+    for (i=0; i<U; ++i)
+        res[i] = ref[i] && other[i];
+    u = intset_intersect(s, t);
+    fail_unless(u != NULL);
+    check_set(u, res);
+    intset_free(u);
+
+    /* and with runs */
+    intset_optimize(s);
+    intset_optimize(t);
+    u = intset_intersect(t, s);
+    fail_unless(u != NULL);
+    check_set(u, res);
+    intset_free(u);
+
+    intset_free(t);
+}
+END_TEST
+
+START_TEST (test_intset_runs)
+{
+    intset *t, *u;
+    long x, last = LONG_MIN;
+
+    /* one long run, spanning many bitmap words */
+    for (x=47105; x<50105; ++x)
+        fail_unless(intset_insert(s, x) == 0);
+    intset_optimize(s);
+
+    fail_unless(intset_size(s) == 3000);
+    fail_unless(!intset_contains(s, 47104) && intset_contains(s, 47105));
+    fail_unless(intset_contains(s, 50104) && !intset_contains(s, 50105));
+    fail_unless(intset_range(s, LONG_MIN, LONG_MAX, count_keys, &last) == 3000);
+    fail_unless(last == 50104);
+    fail_unless(intset_range(s, 48000, 48999, NULL, NULL) == 1000);
+    fail_unless(intset_rank(s, 50000) == 50000 - 47105);
+
+    t = intset_init();
+    for (x=50000; x<53000; ++x)
+        intset_insert(t, x);
+    intset_optimize(t);
+
+    u = intset_union(s, t);
+    fail_unless(u != NULL && intset_size(u) == 53000 - 47105);
+    last = LONG_MIN;
+    fail_unless(intset_range(u, LONG_MIN, LONG_MAX, count_keys, &last) == intset_size(u));
+    intset_free(u);
+
+    u = intset_intersect(s, t);
+    fail_unless(u != NULL && intset_size(u) == 105);
+    intset_free(u);
+    intset_free(t);
+
+    /* splitting the run */
+    fail_unless(intset_remove(s, 48000) == 0);
+    fail_unless(!intset_contains(s, 48000) && intset_contains(s, 48001));
+    fail_unless(intset_range(s, 47105, 50104, NULL, NULL) == 2999);
+}
+END_TEST
+
+Suite *intset_suite(void)
+{
+    Suite *s = suite_create("intset");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_intset);
+    tcase_add_test(tc_simple, test_intset_ops);
+    tcase_add_test(tc_simple, test_intset_runs);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, intset_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <time.h>
+#include <check.h>
+
+#include "itree.h"
+
+#define N 10000
+#define SPAN (10 * N)
+
+itree *t;
+long starts[N], ends[N];
+
+
+static void setup(void)
+{
+    size_t i;
+
+    t = itree_init();
+
+    srand(time(NULL));
+
+    /* mostly short intervals, some long ones; starts ascending */
+    for (i=0; i<N; ++i)
+    {
+        starts[i] = (i) ? starts[i - 1] + rand() % 20 : 0;
+        ends[i] = starts[i] + 1 + ((rand() % 100) ? rand() % 50 : rand() % SPAN);
+    }
+}
+
+static void teardown(void)
+{
+    itree_free(t, NULL);
+}
+
+static size_t count_overlap(long lo, long hi)
+{
+    size_t i, n = 0;
+
+    for (i=0; i<N; ++i)
+    {
+        if (starts[i] < ends[i] && starts[i] < hi && ends[i] > lo)
+            n++;
+    }
+    return n;
+}
+
+static void check_interval(long start, long end, void *data, void *arg)
+{
+    long *range = arg;
+    long *s = data;
+
+    fail_unless(*s == start && ends[s - starts] == end);
+    fail_unless(start < range[1] && end > range[0]);
+    /* ordered by start */
+    fail_unless(start >= range[2]);
+    range[2] = start;
+}
+
+static void check_queries(void)
+{
+    long range[3], x;
+    int i;
+
+    for (i=0; i<100; ++i)
+    {
+        x = rand() % (starts[N - 1] + 1);
+
+        range[0] = x;
+        range[1] = x + 1;
+        range[2] = 0;
+        fail_unless(itree_stab(t, x, check_interval, range) == count_overlap(x, x + 1));
+
+        range[1] = x + rand() % 100 + 1;
+        range[2] = 0;
+        fail_unless(itree_overlap(t, x, range[1], check_interval, range) ==
+                count_overlap(x, range[1]));
+    }
+}
+
+START_TEST (test_itree)
+{
+    size_t i, j;
+
+    /* insert in random order */
+    for (i=0; i<N; ++i)
+    {
+        j = (i * 7919) % N;
+        fail_unless(itree_insert(t, starts[j], ends[j], &starts[j]) == 0);
+    }
+    fail_unless(itree_insert(t, 5, 5, NULL) == -1);
+    fail_unless(itree_size(t) == N);
+
+    check_queries();
+    fail_unless(itree_stab(t, -1, NULL, NULL) == 0);
+    fail_unless(itree_overlap(t, 0, 0, NULL, NULL) == 0);
+    fail_unless(itree_overlap(t, starts[0], ends[N - 1], NULL, NULL) == N);
+
+    /* same interval, other data */
+    fail_unless(itree_insert(t, starts[0], ends[0], NULL) == 0);
+    fail_unless(itree_stab(t, starts[0], NULL, NULL) == count_overlap(starts[0], starts[0] + 1) + 1);
+    fail_unless(itree_remove(t, starts[0], ends[0], NULL) == 0);
+    fail_unless(itree_remove(t, starts[0], ends[0], NULL) == -1);
+    fail_unless(itree_remove(t, starts[0], ends[0] + 1, &starts[0]) == -1);
+
+    /* remove the long intervals, making them empty */
+    for (i=0; i<N; ++i)
+    {
+        if (ends[i] - starts[i] > 50)
+        {
+            fail_unless(itree_remove(t, starts[i], ends[i], &starts[i]) == 0);
+            ends[i] = starts[i];
+        }
+    }
+    check_queries();
+}
+END_TEST
+
+START_TEST (test_itree_build)
+{
+    void *data[N];
+    size_t i;
+
+    for (i=0; i<N; ++i)
+        data[i] = &starts[i];
+
+    itree_free(t, NULL);
+    t = itree_build_sorted(starts, ends, data, N);
+    fail_unless(t != NULL);
+    fail_unless(itree_size(t) == N);
+    check_queries();
+
+    /* reuses the removed intervals' memory */
+    for (i=0; i<N; ++i)
+        fail_unless(itree_remove(t, starts[i], ends[i], &starts[i]) == 0);
+    fail_unless(itree_size(t) == 0);
+    for (i=0; i<N; ++i)
+        fail_unless(itree_insert(t, starts[i], ends[i], &starts[i]) == 0);
+    check_queries();
+
+    itree_clear(t, NULL);
+    fail_unless(itree_size(t) == 0);
+    fail_unless(itree_insert(t, 0, 10, &starts[0]) == 0);
+    fail_unless(itree_stab(t, 9, NULL, NULL) == 1);
+    fail_unless(itree_stab(t, 10, NULL, NULL) == 0);
+
+    fail_unless(itree_build_sorted(ends, starts, NULL, N) == NULL);
+}
+END_TEST
+
+Suite *itree_suite(void)
+{
+    Suite *s = suite_create("interval tree");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_itree);
+    tcase_add_test(tc_simple, test_itree_build);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, itree_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <time.h>
+#include <check.h>
+
+#include "queue.h"
+
+#define N 10000
+
+queue *q;
+long numbers[N];
+size_t freed;
+
+
+static void count_free(void *data)
+{
+    freed++;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+    return *(const long*)a != *(const long*)b;
+}
+
+static void setup(void)
+{
+    size_t i;
+
+    freed = 0;
+    q = q_init();
+
+    for (i=0; i<N; ++i)
+        numbers[i] = i;
+}
+
+static void teardown(void)
+{
+    q_free(q, NULL);
+}
+
+START_TEST (test_queue)
+{
+    long x = N / 2, y = N;
+    size_t i;
+
+    fail_unless(q_empty(q));
+    fail_unless(q_dequeue(q) == NULL);
+
+    for (i=0; i<N; ++i)
+        fail_unless(q_enqueue(q, &numbers[i]) == 0);
+    fail_unless(!q_empty(q));
+    fail_unless(q_contains(q, &x, cmp_long));
+    fail_unless(!q_contains(q, &y, cmp_long));
+
+    for (i=0; i<N; ++i)
+        fail_unless(q_dequeue(q) == &numbers[i]);
+    fail_unless(q_empty(q));
+
+    /* requeued items come first, in reverse */
+    for (i=0; i<N; ++i)
+    {
+        if (i % 2)
+            fail_unless(q_requeue(q, &numbers[i]) == 0);
+        else
+            fail_unless(q_enqueue(q, &numbers[i]) == 0);
+    }
+    for (i=N; i-- > 0; )
+    {
+        if (i % 2)
+            fail_unless(q_dequeue(q) == &numbers[i]);
+    }
+    for (i=0; i<N; i+=2)
+        fail_unless(q_dequeue(q) == &numbers[i]);
+    fail_unless(q_empty(q));
+
+    for (i=0; i<N; ++i)
+        q_enqueue(q, &numbers[i]);
+    q_clear(q, count_free);
+    fail_unless(freed == N);
+    fail_unless(q_empty(q));
+}
+END_TEST
+
+START_TEST (test_queue_wrap)
+{
+    size_t i, head = 0, tail = 0;
+
+    srand(time(NULL));
+
+    /* the queue grows and shrinks while its items wrap around */
+    for (i=0; i<50*N; ++i)
+    {
+        if (tail < N && (head == tail || rand() % 100 < ((i / N) % 2 ? 30 : 70)))
+            fail_unless(q_enqueue(q, &numbers[tail++ % N]) == 0);
+        else if (head < tail)
+            fail_unless(q_dequeue(q) == &numbers[head++ % N]);
+
+        if (head == N)
+            head = tail = 0;
+    }
+
+    while (head < tail)
+        fail_unless(q_dequeue(q) == &numbers[head++]);
+    fail_unless(q_empty(q));
+}
+END_TEST
+
+Suite *queue_suite(void)
+{
+    Suite *s = suite_create("queue");
+
+    TCase *tc_simple = tcase_create("simple");
+
+    tcase_add_checked_fixture (tc_simple, setup, teardown);
+
+    tcase_add_test(tc_simple, test_queue);
+    tcase_add_test(tc_simple, test_queue_wrap);
+
+    suite_add_tcase(s, tc_simple);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    SRunner *sr = srunner_create(NULL);
+
+    srunner_add_suite(sr, queue_suite());
+
+    srunner_set_fork_status(sr, CK_NOFORK);
+
+    srunner_run_all(sr, CK_NORMAL);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}